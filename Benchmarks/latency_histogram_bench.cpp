@@ -0,0 +1,86 @@
+//
+//  latency_histogram_bench.cpp
+//  Benchmarks
+//
+//  Created by АА on 17.10.26.
+//
+//  Measures what LatencyHistogram::Record costs on one thread and with
+//  several threads recording into the same histogram, and how far its
+//  percentiles are from the exact ones of the same values.
+//
+//  g++ -std=c++20 -O2 -I../Messenger -o latency_histogram_bench latency_histogram_bench.cpp ../Messenger/latency_histogram.cpp -lpthread
+//
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "latency_histogram.hpp"
+
+namespace {
+
+const std::size_t RECORDS = 10000000;
+
+/**
+ * Latency-like values in microseconds: mostly a few milliseconds, with a long tail.
+ */
+std::vector<std::uint64_t> MakeValues(std::size_t count){
+    std::mt19937_64 random(42);
+    std::lognormal_distribution<double> latency(std::log(3000.0), 0.8);
+    std::vector<std::uint64_t> values(count);
+    for(std::uint64_t& value : values) value = (std::uint64_t)latency(random);
+    return values;
+}
+
+/**
+ * Records values from threads threads at once, all into the shared
+ * histogram, and returns the wall time per recorded value in nanoseconds.
+ * With fewer cores than threads this shows no contention, only overhead.
+ */
+double RecordNs(LatencyHistogram& histogram, const std::vector<std::uint64_t>& values, int threads){
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; t++){
+        workers.emplace_back([&histogram, &values, t, threads](){
+            for(std::size_t i = t; i < values.size(); i += threads) histogram.Record(values[i]);
+        });
+    }
+    for(std::thread& worker : workers) worker.join();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / values.size();
+}
+
+}
+
+int main(){
+    std::vector<std::uint64_t> values = MakeValues(RECORDS);
+
+    printf("%8s %14s\n", "threads", "ns per record");
+    for(int threads : {1, 2, 4}){
+        auto histogram = std::make_unique<LatencyHistogram>();
+        printf("%8d %14.1f\n", threads, RecordNs(*histogram, values, threads));
+    }
+
+    // Per-thread histograms merged into one give the same answer as a shared one
+    auto merged = std::make_unique<LatencyHistogram>();
+    for(int part = 0; part < 4; part++){
+        auto own = std::make_unique<LatencyHistogram>();
+        for(std::size_t i = part; i < values.size(); i += 4) own->Record(values[i]);
+        merged->Merge(*own);
+    }
+
+    std::vector<std::uint64_t> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    printf("\n%8s %12s %12s %8s\n", "pct", "exact us", "recorded us", "error");
+    for(double percent : {50.0, 90.0, 99.0, 99.9, 99.99}){
+        std::uint64_t exact = sorted[(std::size_t)std::ceil(sorted.size() * percent / 100.0) - 1];
+        std::uint64_t recorded = merged->Percentile(percent);
+        printf("%8.2f %12llu %12llu %7.2f%%\n", percent, (unsigned long long)exact, (unsigned long long)recorded,
+               100.0 * ((double)recorded - exact) / exact);
+    }
+    return 0;
+}
@@ -0,0 +1,299 @@
+//
+//  loadgen.cpp
+//  Benchmarks
+//
+//  Created by АА on 17.10.26.
+//
+//  Headless load generator: simulates many users talking to the server
+//  through Backend. Each user registers, logs in, then polls /get-chat and
+//  sends messages to a partner at the configured rates until the run ends.
+//  Prints throughput, error rate and latency percentiles per endpoint.
+//
+//  Load is open-loop: every request has an intended start time drawn up
+//  front (Poisson arrivals for sends, a fixed period for polls) and goes
+//  out at that time whether or not earlier requests came back. Latency is
+//  measured from the intended start, so a slow server or a lagging
+//  generator shows up in the tail instead of silently lowering the load.
+//  Logins during sign-up are the exception: each one goes out when the
+//  user's registration comes back, so it is closed-loop and its latency
+//  counts from that moment, not from the start of the burst.
+//
+//  g++ -std=c++20 -O2 -I../Messenger -o loadgen loadgen.cpp $(ls ../Messenger/*.cpp | grep -v main.cpp) -lcurl -lpthread
+//
+//  ./loadgen --users 200 --threads 4 --rate 0.5 --poll-ms 2000 --seconds 30
+//
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "backend.hpp"
+#include "http_client.hpp"
+#include "latency_histogram.hpp"
+#include "request_stats.hpp"
+#include "task.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Command line settings.
+ */
+struct Options{
+    std::string url = "http://127.0.0.1:4040";
+    int users = 50;
+    int threads = 2;
+    double rate = 0.2;          // Messages per second per user
+    int pollMs = 3000;          // Time between /get-chat polls of one user
+    int seconds = 20;
+    int connections = 64;
+    int size = 32;              // Message length in bytes
+};
+
+/**
+ * Outcomes of one kind of request, recorded by whichever thread completes it.
+ */
+struct Endpoint{
+    LatencyHistogram latencyUs;     // From the intended start of each request
+    std::atomic<std::uint64_t> errors{0};
+};
+
+enum Kind{
+    Register,
+    Login,
+    Send,
+    Poll,
+    KINDS
+};
+
+const char* const KIND_NAMES[KINDS] = {"register", "login", "send", "get-chat"};
+
+/**
+ * Per scheduling thread results, merged for the report.
+ */
+struct Results{
+    Endpoint endpoints[KINDS];
+};
+
+struct User{
+    std::string name;
+    std::string partner;
+    std::atomic<long long> cursor{0};
+};
+
+std::atomic<int> inflight{0};
+
+void Finish(Endpoint& endpoint, Clock::time_point intended, bool ok){
+    auto elapsed = Clock::now() - intended;
+    endpoint.latencyUs.Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    if(!ok) endpoint.errors.fetch_add(1, std::memory_order_relaxed);
+    inflight--;
+}
+
+DetachedTask SignUp(User& user, Results& results, Clock::time_point intended){
+    bool registered = co_await Backend::RegisterCo(user.name, "loadgen");
+    Finish(results.endpoints[Register], intended, registered);
+
+    // Closed-loop: there is no intended time before the registration answered
+    inflight++;
+    Clock::time_point loginStart = Clock::now();
+    bool loggedIn = co_await Backend::LoginCo(user.name, "loadgen");
+    Finish(results.endpoints[Login], loginStart, loggedIn);
+}
+
+DetachedTask SendOne(User& user, Results& results, Clock::time_point intended, std::string message){
+    SendReceipt receipt = co_await Backend::SendMessageCo(user.name, user.partner, message);
+    Finish(results.endpoints[Send], intended, receipt.ok);
+}
+
+DetachedTask PollOne(User& user, Results& results, Clock::time_point intended){
+    ChatDelta delta = co_await Backend::GetChatCo(user.name, user.partner, user.cursor.load());
+    if(delta.ok){
+        long long seen = user.cursor.load();
+        while(delta.cursor > seen && !user.cursor.compare_exchange_weak(seen, delta.cursor)){}
+    }
+    Finish(results.endpoints[Poll], intended, delta.ok);
+}
+
+/**
+ * A request due at a given time.
+ */
+struct Due{
+    Clock::time_point at;
+    std::size_t user;
+    Kind kind;
+
+    bool operator>(const Due& other) const { return at > other.at; }
+};
+
+/**
+ * Issues the sends and polls of users [first, last) at their intended
+ * times until end. Never waits for a response.
+ */
+void Drive(std::vector<std::unique_ptr<User>>& users, std::size_t first, std::size_t last, const Options& options,
+           Results& results, Clock::time_point start, Clock::time_point end, unsigned seed){
+    std::mt19937_64 random(seed);
+    std::exponential_distribution<double> gap(options.rate > 0 ? options.rate : 1);
+    std::uniform_real_distribution<double> phase(0, options.pollMs / 1000.0);
+    auto seconds = [](double s){ return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s)); };
+
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due;
+    for(std::size_t i = first; i < last; i++){
+        if(options.rate > 0) due.push({start + seconds(gap(random)), i, Send});
+        if(options.pollMs > 0) due.push({start + seconds(phase(random)), i, Poll});
+    }
+
+    std::string filler(std::max(options.size, 1), 'x');
+    std::uint64_t sent = 0;
+    while(!due.empty() && due.top().at < end){
+        Due next = due.top();
+        due.pop();
+        std::this_thread::sleep_until(next.at);
+
+        User& user = *users[next.user];
+        inflight++;
+        if(next.kind == Send){
+            std::string message = std::to_string(sent++) + " " + filler;
+            message.resize(options.size);
+            SendOne(user, results, next.at, std::move(message));
+            // The next arrival does not depend on when this one is answered
+            due.push({next.at + seconds(gap(random)), next.user, Send});
+        } else {
+            PollOne(user, results, next.at);
+            due.push({next.at + std::chrono::milliseconds(options.pollMs), next.user, Poll});
+        }
+    }
+}
+
+/**
+ * Waits until no request is in flight, or until timeout.
+ */
+bool Drain(std::chrono::seconds timeout){
+    Clock::time_point limit = Clock::now() + timeout;
+    while(inflight > 0 && Clock::now() < limit){
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return inflight == 0;
+}
+
+void Report(const char* phase, const std::vector<std::unique_ptr<Results>>& results, double seconds){
+    printf("\n%s\n%-10s %9s %9s %8s %9s %9s %9s %9s %9s\n", phase, "endpoint", "requests", "req/s", "errors",
+           "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms");
+    for(int kind = 0; kind < KINDS; kind++){
+        auto merged = std::make_unique<Endpoint>();
+        for(const auto& result : results){
+            merged->latencyUs.Merge(result->endpoints[kind].latencyUs);
+            merged->errors += result->endpoints[kind].errors.load();
+        }
+        std::uint64_t count = merged->latencyUs.Count();
+        if(count == 0) continue;
+        const LatencyHistogram& latency = merged->latencyUs;
+        printf("%-10s %9llu %9.1f %7.2f%% %9.1f %9.1f %9.1f %9.1f %9.1f\n", KIND_NAMES[kind], (unsigned long long)count,
+               count / seconds, 100.0 * merged->errors / count,
+               latency.Percentile(50) / 1000.0, latency.Percentile(90) / 1000.0, latency.Percentile(99) / 1000.0,
+               latency.Percentile(99.9) / 1000.0, latency.Max() / 1000.0);
+    }
+}
+
+/**
+ * Ends the run without destroying the client or the results. Requests still
+ * in flight would otherwise resume into freed memory when they complete.
+ */
+[[noreturn]] void Abandon(int code){
+    fflush(stdout);
+    fflush(stderr);
+    _exit(code);
+}
+
+bool Parse(int argc, char** argv, Options& options){
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string name = argv[i];
+        const char* value = argv[i + 1];
+        if(name == "--url") options.url = value;
+        else if(name == "--users") options.users = atoi(value);
+        else if(name == "--threads") options.threads = atoi(value);
+        else if(name == "--rate") options.rate = atof(value);
+        else if(name == "--poll-ms") options.pollMs = atoi(value);
+        else if(name == "--seconds") options.seconds = atoi(value);
+        else if(name == "--connections") options.connections = atoi(value);
+        else if(name == "--size") options.size = atoi(value);
+        else return false;
+    }
+    return argc % 2 == 1 && options.users >= 2 && options.threads >= 1 && options.connections >= 1 && options.seconds >= 1;
+}
+
+}
+
+int main(int argc, char** argv){
+    Options options;
+    if(!Parse(argc, argv, options)){
+        fprintf(stderr, "usage: %s [--url URL] [--users N] [--threads N] [--rate MSG_PER_S_PER_USER]\n"
+                        "          [--poll-ms MS] [--seconds S] [--connections N] [--size BYTES]\n", argv[0]);
+        return 2;
+    }
+    Backend::UseClient(std::make_shared<HttpClient>(options.url, options.connections));
+
+    // Users talk in pairs; an odd one out talks to the first user
+    std::vector<std::unique_ptr<User>> users;
+    std::string run = "lg" + std::to_string(getpid()) + "_";
+    for(int i = 0; i < options.users; i++){
+        users.push_back(std::make_unique<User>());
+        users.back()->name = run + std::to_string(i);
+    }
+    for(int i = 0; i < options.users; i++){
+        int partner = (i ^ 1) < options.users ? (i ^ 1) : 0;
+        users[i]->partner = users[partner]->name;
+    }
+
+    // Sign-up: all users at once, as a burst of arrivals
+    std::vector<std::unique_ptr<Results>> signUpResults;
+    signUpResults.push_back(std::make_unique<Results>());
+    Clock::time_point signUp = Clock::now();
+    for(int i = 0; i < options.users; i++){
+        inflight++;
+        SignUp(*users[i], *signUpResults[0], signUp);
+    }
+    bool signedUp = Drain(std::chrono::seconds(60));
+    Report("sign-up", signUpResults, std::chrono::duration<double>(Clock::now() - signUp).count());
+    if(!signedUp){
+        fprintf(stderr, "sign-up did not finish\n");
+        Abandon(1);
+    }
+
+    std::vector<std::unique_ptr<Results>> results;
+    for(int t = 0; t < options.threads; t++) results.push_back(std::make_unique<Results>());
+
+    // Steady state: each thread drives its share of the users
+    printf("\n%d users on %d threads, %.2f msg/s and a poll every %d ms per user, for %d s\n",
+           options.users, options.threads, options.rate, options.pollMs, options.seconds);
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(100);
+    Clock::time_point end = start + std::chrono::seconds(options.seconds);
+    std::vector<std::thread> drivers;
+    for(int t = 0; t < options.threads; t++){
+        std::size_t first = (std::size_t)options.users * t / options.threads;
+        std::size_t last = (std::size_t)options.users * (t + 1) / options.threads;
+        drivers.emplace_back(Drive, std::ref(users), first, last, std::cref(options), std::ref(*results[t]), start, end, 1234u + t);
+    }
+    for(std::thread& driver : drivers) driver.join();
+    bool drained = Drain(std::chrono::seconds(30));
+
+    Report("steady state", results, options.seconds);
+    if(!drained) printf("%d requests still unanswered after 30 s, not counted\n", inflight.load());
+
+    printf("\nHTTP breakdown per endpoint, from libcurl\n");
+    for(const std::string& line : RequestStats::Shared().Report()){
+        printf("%s\n", line.c_str());
+    }
+    if(!drained) Abandon(0);
+    Backend::UseClient(nullptr);
+    return 0;
+}
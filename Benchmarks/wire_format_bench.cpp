@@ -0,0 +1,83 @@
+//
+//  wire_format_bench.cpp
+//  Benchmarks
+//
+//  Created by АА on 17.10.26.
+//
+//  Compares JSON and MessagePack chat payloads: encoded size and the time
+//  ChatStreamDecoder needs to decode them.
+//
+//  g++ -std=c++20 -O2 -I../Messenger -o wire_format_bench wire_format_bench.cpp ../Messenger/chat_codec.cpp
+//
+
+#include <stdio.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "json-2.hpp"
+#include "chat_codec.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+/**
+ * Builds a /get-chat response body with count messages between two users.
+ */
+json MakeChat(std::size_t count){
+    json chat = json::array();
+    for(std::size_t i = 0; i < count; i++){
+        json entry;
+        entry["seq"] = i + 1;
+        entry["sendername"] = i % 2 ? "alice" : "bob";
+        entry["gettername"] = i % 2 ? "bob" : "alice";
+        entry["timestamp"] = 1792263823000 + i * 1000;
+        entry["message"] = "message number " + std::to_string(i) + ", see you tomorrow";
+        chat.push_back(entry);
+    }
+    return chat;
+}
+
+/**
+ * Decodes body in 16 KiB chunks the way a download arrives and returns
+ * the best time over a few runs, in milliseconds.
+ */
+double DecodeMs(const std::string& body, WireFormat format, std::size_t expected){
+    double best = 0;
+    for(int run = 0; run < 5; run++){
+        auto start = std::chrono::steady_clock::now();
+        ChatStreamDecoder decoder(0);
+        decoder.SetFormat(format);
+        for(std::size_t offset = 0; offset < body.size(); offset += 16384){
+            decoder.Feed(body.data() + offset, std::min<std::size_t>(16384, body.size() - offset));
+        }
+        bool finished = decoder.Finish();
+        ChatDelta delta = decoder.Take();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if(!finished || delta.messages.size() != expected){
+            std::cerr << "decode failed" << std::endl;
+            return -1;
+        }
+        if(run == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+}
+
+int main(){
+    printf("%10s %14s %14s %12s %12s\n", "messages", "json bytes", "msgpack bytes", "json ms", "msgpack ms");
+    for(std::size_t count : {1000, 10000, 100000}){
+        json chat = MakeChat(count);
+        std::string text = chat.dump();
+        std::vector<std::uint8_t> packed = json::to_msgpack(chat);
+        std::string binary(packed.begin(), packed.end());
+
+        printf("%10zu %14zu %14zu %12.2f %12.2f\n", count, text.size(), binary.size(),
+               DecodeMs(text, WireFormat::Json, count),
+               DecodeMs(binary, WireFormat::MessagePack, count));
+    }
+    return 0;
+}
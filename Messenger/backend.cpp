@@ -9,327 +9,553 @@
 #include <iostream>
 #include "json-2.hpp"
 #include <string>
-#include <curl/curl.h>
-#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <future>
 #include <map>
+#include <mutex>
+#include <vector>
+#include "http_client.hpp"
+#include "chat_codec.hpp"
+#include "thread_pool.hpp"
+#include "latency_histogram.hpp"
+#include "trace.hpp"
+#include "probes.hpp"
 
 using json = nlohmann::json;
 
+namespace {
+
+const char* MSGPACK_TYPE = "application/msgpack";
+
+// A send that takes longer is reported as failed so it can be retried
+const long SEND_TIMEOUT_MS = 10000;
+
+// A /get-chat, paged or not, that takes longer is reported as failed
+const long FETCH_TIMEOUT_MS = 10000;
+
+// Encoding asked for in the Accept header of read requests
+std::atomic<WireFormat> wireFormat{WireFormat::MessagePack};
+
+// Client used instead of HttpClient::Shared() while set, see Backend::UseClient
+std::mutex clientMutex;
+std::shared_ptr<HttpClient> clientOverride;
+
 /**
- * Callback function used by libcurl to write received data into a std::string.
- * Appends the data chunk received to the string pointed by userp.
- *
- * @param contents Pointer to the received data buffer.
- * @param size Size of each data element (usually 1).
- * @param nmemb Number of elements.
- * @param userp Pointer to std::string where data will be appended.
- * @return Number of bytes processed.
+ * Returns the client requests are currently sent through.
  */
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp){
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
+std::shared_ptr<HttpClient> Client(){
+    std::lock_guard<std::mutex> lock(clientMutex);
+    if(clientOverride) return clientOverride;
+    // Non-owning: the shared client lives for the whole process
+    return std::shared_ptr<HttpClient>(std::shared_ptr<HttpClient>(), &HttpClient::Shared());
 }
 
 /**
- * Registers a new user by sending username and password to the backend server.
- *
- * @param username New user's username.
- * @param password New user's password.
- * @return True if registration was successful, false otherwise.
+ * Adds the Accept header for the configured wire format to a read request.
  */
-bool Backend::Register(const std::string& username, const std::string& password){
-    CURL* curl = curl_easy_init();
-    if(!curl) return false; // Failed to initialize curl
+void Negotiate(HttpRequest& request){
+    if(wireFormat == WireFormat::MessagePack){
+        request.headers.push_back("Accept: application/msgpack, application/json;q=0.5");
+    }
+}
 
-    std::string response;
+/**
+ * Tells which encoding the server chose for a response.
+ */
+WireFormat FormatOf(const HttpResponse& response){
+    return response.Header("content-type").compare(0, std::strlen(MSGPACK_TYPE), MSGPACK_TYPE) == 0 ? WireFormat::MessagePack : WireFormat::Json;
+}
 
-    // Prepare JSON payload
-    json j;
-    j["username"] = username;
-    j["password"] = password;
-    std::string jsonStr = j.dump();
-
-    // Set HTTP headers - content type JSON
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-
-    // Set curl options for POST request to /register endpoint
-    curl_easy_setopt(curl, CURLOPT_URL, "http://127.0.0.1:4040/register");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonStr.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, jsonStr.size());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-    // Perform request asynchronously to avoid blocking
-    std::future<CURLcode> res = std::async(std::launch::async, [&]() {
-        return curl_easy_perform(curl);
+/**
+ * POSTs a JSON payload through the current HttpClient and converts the
+ * response with parse on the thread pool.
+ *
+ * @param request Request with path (and optionally timeout) filled in; the body is set here.
+ * @param payload JSON request body.
+ * @param parse Converts the parsed response into the result.
+ * @param fallback Result used when the request or parsing fails.
+ * @param complete Receives the result on a ThreadPool worker.
+ * @param done Runs on completion before anything else, whether the request succeeded or not.
+ * @return Id of the submitted HttpClient request.
+ */
+template<typename T>
+std::uint64_t PostJson(HttpRequest request, const json& payload, std::function<T(const json&)> parse, T fallback, std::function<void(T)> complete, std::function<void()> done){
+    request.body = payload.dump();
+
+    return Client()->Submit(std::move(request), [complete = std::move(complete), parse = std::move(parse), fallback = std::move(fallback), done = std::move(done)](HttpResponse&& response) mutable {
+        if(done) done();
+        // Parsing and the completion run on the thread pool so the I/O thread keeps driving other transfers
+        ThreadPool::Shared().Submit([complete = std::move(complete), parse = std::move(parse), fallback = std::move(fallback), response = std::move(response)]() mutable {
+            TraceSpan span("backend", "parse");
+            MESSENGER_PROBE1(parse_start, response.body.size());
+            unsigned long long parseStart = MESSENGER_PROBE_NOW(parse_end);
+            T result = std::move(fallback);
+            if(response.result == CURLE_OK){
+                try {
+                    // Parse the response from server in whichever format it answered
+                    if(FormatOf(response) == WireFormat::MessagePack){
+                        result = parse(json::from_msgpack(response.body));
+                    } else {
+                        result = parse(json::parse(response.body));
+                    }
+                } catch (const std::exception& e) {
+                    std::cout << e.what() << std::endl;
+                }
+            }
+            MESSENGER_PROBE2(parse_end, response.body.size(), MESSENGER_PROBE_NOW(parse_end) - parseStart);
+            complete(std::move(result));
+        });
     });
+}
 
-    try {
-        CURLcode result = res.get();
-        if(result != CURLE_OK){
-            // Cleanup curl resources and headers on failure
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
-            return false;
+/**
+ * POSTs a /get-chat style request whose response is decoded while it is
+ * still downloading, see ChatStreamDecoder.
+ *
+ * @param client Client to submit through.
+ * @param request Request with path (and optionally timeout) filled in.
+ * @param payload JSON request body.
+ * @param since Cursor sent in the payload.
+ * @param complete Receives the decoded delta, or FailedChat(since), on a ThreadPool worker.
+ *                 ChatDelta::older comes from the X-Chat-Before header of a paged response.
+ * @param done Runs on completion before complete.
+ * @return Id of the submitted HttpClient request.
+ */
+std::uint64_t PostChat(HttpClient& client, HttpRequest request, const json& payload, long long since, std::function<void(ChatDelta)> complete, std::function<void()> done){
+    auto decoder = std::make_shared<ChatStreamDecoder>(since);
+
+    request.body = payload.dump();
+    Negotiate(request);
+    auto started = std::make_shared<bool>(false);
+    request.onData = [decoder, started](const HttpResponse& head, const char* data, std::size_t size){
+        // Headers are complete by the first body chunk
+        if(!*started){
+            decoder->SetFormat(FormatOf(head));
+            *started = true;
         }
+        return decoder->Feed(data, size);
+    };
+
+    return client.Submit(std::move(request), [decoder, since, complete = std::move(complete), done = std::move(done)](HttpResponse&& response){
+        if(done) done();
+        // JSON is decoded by now; a buffered MessagePack body is decoded by Finish() on the pool
+        ThreadPool::Shared().Submit([decoder, since, complete, ok = response.result == CURLE_OK, older = response.Header("x-chat-before")](){
+            ChatDelta delta = FailedChat(since);
+            try {
+                if(ok && decoder->Finish()){
+                    delta = decoder->Take();
+                    delta.older = std::atoll(older.c_str());
+                }
+            } catch (const std::exception& e) {
+                // Callers wait for complete, so a decoding error must still end in a failed delta
+                std::cout << e.what() << std::endl;
+                delta = FailedChat(since);
+            }
+            complete(std::move(delta));
+        });
+    });
+}
 
-        // Parse JSON response from server
-        json jsonResult = json::parse(response);
-
-        // Return success flag from response
-        bool success = jsonResult["success"];
-        // Cleanup curl resources and headers on success
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return success;
-    } catch (const std::exception& e) {
-        std::cout << e.what() << std::endl;
-        // Cleanup on exception
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return false;
-    }
+/**
+ * Pairs a future with the completion callback that fulfils it.
+ */
+template<typename T>
+std::pair<std::future<T>, std::function<void(T)>> Promised(){
+    auto promise = std::make_shared<std::promise<T>>();
+    std::future<T> future = promise->get_future();
+    return {std::move(future), [promise](T value){ promise->set_value(std::move(value)); }};
 }
 
 /**
- * Logs in a user by sending credentials to the backend server.
- *
- * @param username User's username.
- * @param password User's password.
- * @return True if login was successful, false otherwise.
+ * Wraps complete so the time from now until it is called goes into histogram.
  */
-bool Backend::Login(const std::string& username, const std::string& password){
-    CURL* curl = curl_easy_init();
-    if(!curl) return false; // Failed to initialize curl
+template<typename T>
+std::function<void(T)> Timed(LatencyHistogram& histogram, std::function<void(T)> complete){
+    auto start = std::chrono::steady_clock::now();
+    return [&histogram, start, complete = std::move(complete)](T result){
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        histogram.Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        complete(std::move(result));
+    };
+}
+
+/**
+ * Reads the success flag every simple endpoint replies with.
+ */
+bool ParseSuccess(const json& jsonResult){
+    // Error bodies may leave the flag out
+    return jsonResult.value("success", false);
+}
+
+/**
+ * Reads a /send-message reply: the success flag and the stored message, if sent along.
+ */
+SendReceipt ParseReceipt(const json& jsonResult){
+    SendReceipt receipt;
+    receipt.ok = jsonResult.value("success", false);
+    auto stored = jsonResult.find("message");
+    if(receipt.ok && stored != jsonResult.end() && stored->is_object()){
+        receipt.message = stored->get<ChatMessage>();
+    }
+    return receipt;
+}
 
-    std::string response;
+// Ids of /wait-chat requests in flight and the client each went through, so CancelWaits() can abort them
+std::mutex waitsMutex;
+std::map<std::uint64_t, std::shared_ptr<HttpClient>> waits;
+// Set by CancelWaits() until ResumeWaits(), so a wait started just after the cancel fails at once
+bool waitsCancelled = false;
 
+// Request builders shared by the future and coroutine variants of each call
+
+void StartRegister(const std::string& username, const std::string& password, std::function<void(bool)> complete){
+    // Prepare JSON payload
     json j;
     j["username"] = username;
     j["password"] = password;
-    std::string jsonStr = j.dump();
 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-
-    curl_easy_setopt(curl, CURLOPT_URL, "http://127.0.0.1:4040/login");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonStr.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, jsonStr.size());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    HttpRequest request;
+    request.path = "/register";
+    PostJson<bool>(std::move(request), j, ParseSuccess, false, std::move(complete), nullptr);
+}
 
-    std::future<CURLcode> res = std::async(std::launch::async, [&]() {
-        return curl_easy_perform(curl);
-    });
+void StartLogin(const std::string& username, const std::string& password, std::function<void(bool)> complete){
+    json j;
+    j["username"] = username;
+    j["password"] = password;
 
-    try {
-        CURLcode result = res.get();
-        if(result != CURLE_OK){
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
-            return false;
-        }
+    HttpRequest request;
+    request.path = "/login";
+    PostJson<bool>(std::move(request), j, ParseSuccess, false, std::move(complete), nullptr);
+}
 
-        json jsonResult = json::parse(response);
-
-        bool success = jsonResult["success"];
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return success;
-    } catch (const std::exception& e) {
-        std::cout << e.what() << std::endl;
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return false;
+void StartSendMessage(const std::string& username, const std::string& friendname, const std::string& message, const std::string& clientId, std::function<void(SendReceipt)> complete){
+    json j;
+    j["username"] = username;
+    j["friendname"] = friendname;
+    j["message"] = message;
+    if(!clientId.empty()){
+        j["clientId"] = clientId;
     }
+
+    HttpRequest request;
+    request.path = "/send-message";
+    request.timeoutMs = SEND_TIMEOUT_MS;
+    PostJson<SendReceipt>(std::move(request), j, ParseReceipt, SendReceipt{}, Timed(ChatLatency::Shared().send, std::move(complete)), nullptr);
 }
 
-/**
- * Sends a chat message from username to friendname.
- *
- * @param username Sender's username.
- * @param friendname Recipient's username.
- * @param message Text message to send.
- * @return True if message was sent successfully, false otherwise.
- */
-bool Backend::SendMessage(const std::string& username, const std::string& friendname, const std::string& message){
-    CURL* curl = curl_easy_init();
-    if(!curl) return false;
+void StartGetChat(const std::string& username, const std::string& friendname, long long since, std::function<void(ChatDelta)> complete){
+    json j;
+    j["username"] = username;
+    j["friendname"] = friendname;
+    j["since"] = since;
 
-    std::string response;
+    HttpRequest request;
+    request.path = "/get-chat";
+    request.timeoutMs = FETCH_TIMEOUT_MS;
+    PostChat(*Client(), std::move(request), j, since, Timed(ChatLatency::Shared().fetch, std::move(complete)), nullptr);
+}
 
+void StartGetChatPage(const std::string& username, const std::string& friendname, std::size_t limit, long long before, std::function<void(ChatDelta)> complete){
     json j;
     j["username"] = username;
     j["friendname"] = friendname;
-    j["message"] = message;
+    j["limit"] = limit;
+    if(before > 0){
+        j["before"] = before;
+    }
 
-    std::string jsonStr = j.dump();
+    HttpRequest request;
+    request.path = "/get-chat";
+    request.timeoutMs = FETCH_TIMEOUT_MS;
+    PostChat(*Client(), std::move(request), j, 0, Timed(ChatLatency::Shared().fetch, std::move(complete)), nullptr);
+}
 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+void StartWaitChat(const std::string& username, const std::string& friendname, long long since, long timeoutMs, std::function<void(ChatDelta)> complete){
+    json j;
+    j["username"] = username;
+    j["friendname"] = friendname;
+    j["since"] = since;
+    j["timeout"] = timeoutMs;
+
+    HttpRequest request;
+    request.path = "/wait-chat";
+    request.timeoutMs = timeoutMs + 5000; // Give the server time to answer an expired wait
+
+    std::shared_ptr<HttpClient> client = Client();
+    auto id = std::make_shared<std::uint64_t>(0);
+
+    // Held across Submit so the completion cannot run before the id is recorded
+    std::unique_lock<std::mutex> lock(waitsMutex);
+    if(waitsCancelled){
+        lock.unlock();
+        complete(FailedChat(since));
+        return;
+    }
+    *id = PostChat(*client, std::move(request), j, since, std::move(complete), [id](){
+        std::lock_guard<std::mutex> lock(waitsMutex);
+        waits.erase(*id);
+    });
+    waits[*id] = client;
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, "http://127.0.0.1:4040/send-message");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonStr.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, jsonStr.size());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+void StartGetUsers(const std::string& username, std::function<void(std::map<int, std::string>)> complete){
+    using Users = std::map<int, std::string>;
 
-    std::future<CURLcode> res = std::async(std::launch::async, [&]() {
-        return curl_easy_perform(curl);
-    });
+    json j;
+    j["username"] = username;
+
+    HttpRequest request;
+    request.path = "/get-users";
+    Negotiate(request);
+    PostJson<Users>(std::move(request), j, [](const json& jsonResult){
+        Users users;
 
-    try {
-        CURLcode result = res.get();
-        if(result != CURLE_OK){
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
-            return false;
+        // Parse JSON array containing user info and fill the map
+        for (auto& el : jsonResult) {
+            int id = el["id"].get<int>();
+            std::string username = el["username"].get<std::string>();
+            users.insert({id, username});
         }
+        return users;
+    }, Users{}, std::move(complete), nullptr);
+}
 
-        json jsonResult = json::parse(response);
-
-        bool success = jsonResult["success"];
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return success;
-    } catch (const std::exception& e) {
-        std::cout << e.what() << std::endl;
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return false;
-    }
 }
 
 /**
- * Retrieves the chat history between username and friendname.
+ * Sets how many requests Backend may keep in flight at once.
+ * Further calls are queued until a connection frees up.
  *
- * @param username One chat participant.
- * @param friendname Other chat participant.
- * @return Vector of pairs, each containing sender's username and message.
+ * @param size Maximum number of pooled connections.
  */
-std::vector<std::pair<std::string, std::string>> Backend::GetChat(const std::string& username, const std::string& friendname){
-    CURL* curl = curl_easy_init();
-    if(!curl) return {}; // Failed to initialize curl
+void Backend::SetPoolSize(std::size_t size){
+    Client()->SetMaxConnections(size);
+}
 
-    std::string response;
+/**
+ * Sends all further requests through client instead of the shared
+ * HttpClient, e.g. one driven by the UI's Reactor. Requests already in
+ * flight finish on the client they started on.
+ *
+ * @param client Client to use, or nullptr to go back to HttpClient::Shared().
+ */
+void Backend::UseClient(std::shared_ptr<HttpClient> client){
+    std::lock_guard<std::mutex> lock(clientMutex);
+    clientOverride = std::move(client);
+}
 
-    json j;
-    j["username"] = username;
-    j["friendname"] = friendname;
+/**
+ * Chooses the encoding requested for chats and user lists. MessagePack
+ * bodies are smaller and cheaper to decode; JSON is easier to inspect.
+ *
+ * @param format Preferred response encoding.
+ */
+void Backend::SetWireFormat(WireFormat format){
+    wireFormat = format;
+}
 
-    std::string jsonStr = j.dump();
+/**
+ * Registers a new user by sending username and password to the backend server.
+ *
+ * @param username New user's username.
+ * @param password New user's password.
+ * @return Future resolving to true if registration was successful.
+ */
+std::future<bool> Backend::RegisterAsync(const std::string& username, const std::string& password){
+    auto [future, complete] = Promised<bool>();
+    StartRegister(username, password, std::move(complete));
+    return std::move(future);
+}
 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+/**
+ * Logs in a user by sending credentials to the backend server.
+ *
+ * @param username User's username.
+ * @param password User's password.
+ * @return Future resolving to true if login was successful.
+ */
+std::future<bool> Backend::LoginAsync(const std::string& username, const std::string& password){
+    auto [future, complete] = Promised<bool>();
+    StartLogin(username, password, std::move(complete));
+    return std::move(future);
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, "http://127.0.0.1:4040/get-chat");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonStr.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, jsonStr.size());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+/**
+ * Sends a chat message from username to friendname.
+ *
+ * @param username Sender's username.
+ * @param friendname Recipient's username.
+ * @param message Text message to send.
+ * @param clientId Optional id the server uses to ignore resends of the same message.
+ * @return Future resolving to whether the message was stored, with the stored copy so it
+ *         can be shown before the chat is fetched again.
+ */
+std::future<SendReceipt> Backend::SendMessageAsync(const std::string& username, const std::string& friendname, const std::string& message, const std::string& clientId){
+    auto [future, complete] = Promised<SendReceipt>();
+    StartSendMessage(username, friendname, message, clientId, std::move(complete));
+    return std::move(future);
+}
 
-    std::future<CURLcode> res = std::async(std::launch::async, [&]() {
-        return curl_easy_perform(curl);
-    });
+/**
+ * Retrieves the chat messages between username and friendname that are newer than since.
+ *
+ * @param username One chat participant.
+ * @param friendname Other chat participant.
+ * @param since Cursor from a previous ChatDelta, 0 for the whole history.
+ * @return Future resolving to the new messages and the cursor to pass next time.
+ */
+std::future<ChatDelta> Backend::GetChatAsync(const std::string& username, const std::string& friendname, long long since){
+    auto [future, complete] = Promised<ChatDelta>();
+    StartGetChat(username, friendname, since, std::move(complete));
+    return std::move(future);
+}
 
-    try {
-        CURLcode result = res.get();
-        if(result != CURLE_OK){
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
-            return {};
-        }
+/**
+ * Retrieves one page of the chat: the newest limit messages older than
+ * before. Start with before = 0 and continue with the returned
+ * ChatDelta::older to walk back through the history.
+ *
+ * @param username One chat participant.
+ * @param friendname Other chat participant.
+ * @param limit Page size; the server caps it.
+ * @param before Continuation from the previous page, 0 for the newest messages.
+ * @return Future resolving to the page in order; its cursor is the newest id on it.
+ */
+std::future<ChatDelta> Backend::GetChatPageAsync(const std::string& username, const std::string& friendname, std::size_t limit, long long before){
+    auto [future, complete] = Promised<ChatDelta>();
+    StartGetChatPage(username, friendname, limit, before, std::move(complete));
+    return std::move(future);
+}
 
-        json jsonResult = json::parse(response);
+/**
+ * Callback variant of GetChatPageAsync.
+ *
+ * @param complete Receives the page on a ThreadPool worker.
+ */
+void Backend::GetChatPageAsync(const std::string& username, const std::string& friendname, std::size_t limit, long long before, std::function<void(ChatDelta)> complete){
+    StartGetChatPage(username, friendname, limit, before, std::move(complete));
+}
 
-        std::vector<std::pair<std::string, std::string>> messages;
+/**
+ * Long-poll variant of GetChatAsync: the server holds the request until a
+ * message newer than since exists or timeoutMs passes, so new messages
+ * arrive one round-trip after they are sent and an idle chat costs one
+ * request per timeout.
+ *
+ * @param username One chat participant.
+ * @param friendname Other chat participant.
+ * @param since Cursor from a previous ChatDelta.
+ * @param timeoutMs How long the server may hold the request (at most 120000).
+ * @return Future resolving to the new messages, possibly none after a timeout.
+ */
+std::future<ChatDelta> Backend::WaitChatAsync(const std::string& username, const std::string& friendname, long long since, long timeoutMs){
+    auto [future, complete] = Promised<ChatDelta>();
+    StartWaitChat(username, friendname, since, timeoutMs, std::move(complete));
+    return std::move(future);
+}
 
-        // Extract sendername and message fields from each element in the JSON array
-        for (auto& el : jsonResult) {
-            if (el.contains("sendername") && el.contains("message")) {
-                std::string sender = el["sendername"].get<std::string>();
-                std::string message = el["message"].get<std::string>();
-                messages.emplace_back(sender, message);
-            } else {
-                std::cerr << "Invalid chat message format\n";
-            }
-        }
+/**
+ * Callback variant of WaitChatAsync for event loops that must never block.
+ *
+ * @param complete Receives the result on a ThreadPool worker.
+ */
+void Backend::WaitChatAsync(const std::string& username, const std::string& friendname, long long since, long timeoutMs, std::function<void(ChatDelta)> complete){
+    StartWaitChat(username, friendname, since, timeoutMs, std::move(complete));
+}
 
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return messages;
-    } catch (const std::exception& e) {
-        std::cout << e.what() << std::endl;
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return {};
+/**
+ * Aborts every WaitChatAsync request in flight; they resolve with ok == false.
+ * Waits started afterwards fail the same way until ResumeWaits(), so one
+ * that was just about to start when the chat stopped cannot hold it open.
+ */
+void Backend::CancelWaits(){
+    std::lock_guard<std::mutex> lock(waitsMutex);
+    waitsCancelled = true;
+    for(auto& [id, client] : waits){
+        client->Cancel(id);
     }
+    waits.clear();
+}
+
+/**
+ * Lets WaitChatAsync requests go out again after CancelWaits().
+ */
+void Backend::ResumeWaits(){
+    std::lock_guard<std::mutex> lock(waitsMutex);
+    waitsCancelled = false;
 }
 
 /**
  * Retrieves the list of users (except the requesting user).
  *
  * @param username Current user's username (to exclude from list).
- * @return Map of user IDs to usernames.
+ * @return Future resolving to a map of user IDs to usernames.
  */
-std::map<int, std::string> Backend::GetUsers(const std::string& username){
-    CURL* curl = curl_easy_init();
-    if(!curl) return {}; // Failed to initialize curl
+std::future<std::map<int, std::string>> Backend::GetUsersAsync(const std::string& username){
+    auto [future, complete] = Promised<std::map<int, std::string>>();
+    StartGetUsers(username, std::move(complete));
+    return std::move(future);
+}
 
-    std::string response;
+// Coroutine variants: the request starts right away, co_await resumes the
+// caller on a ThreadPool worker once the result is in
 
-    json j;
-    j["username"] = username;
+Awaitable<bool> Backend::RegisterCo(const std::string& username, const std::string& password){
+    auto [awaitable, complete] = Awaitable<bool>::Make();
+    StartRegister(username, password, std::move(complete));
+    return std::move(awaitable);
+}
 
-    std::string jsonStr = j.dump();
+Awaitable<bool> Backend::LoginCo(const std::string& username, const std::string& password){
+    auto [awaitable, complete] = Awaitable<bool>::Make();
+    StartLogin(username, password, std::move(complete));
+    return std::move(awaitable);
+}
 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+Awaitable<SendReceipt> Backend::SendMessageCo(const std::string& username, const std::string& friendname, const std::string& message, const std::string& clientId){
+    auto [awaitable, complete] = Awaitable<SendReceipt>::Make();
+    StartSendMessage(username, friendname, message, clientId, std::move(complete));
+    return std::move(awaitable);
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, "http://127.0.0.1:4040/get-users");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonStr.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, jsonStr.size());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+Awaitable<ChatDelta> Backend::GetChatCo(const std::string& username, const std::string& friendname, long long since){
+    auto [awaitable, complete] = Awaitable<ChatDelta>::Make();
+    StartGetChat(username, friendname, since, std::move(complete));
+    return std::move(awaitable);
+}
 
-    std::future<CURLcode> res = std::async(std::launch::async, [&]() {
-        return curl_easy_perform(curl);
-    });
+Awaitable<std::map<int, std::string>> Backend::GetUsersCo(const std::string& username){
+    auto [awaitable, complete] = Awaitable<std::map<int, std::string>>::Make();
+    StartGetUsers(username, std::move(complete));
+    return std::move(awaitable);
+}
 
-    try {
-        CURLcode result = res.get();
-        if(result != CURLE_OK){
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
-            return {};
-        }
+// Blocking wrappers, kept for callers that have nothing else to do meanwhile
 
-        json jsonResult = json::parse(response);
+bool Backend::Register(const std::string& username, const std::string& password){
+    return RegisterAsync(username, password).get();
+}
 
-        std::map<int, std::string> users;
+bool Backend::Login(const std::string& username, const std::string& password){
+    return LoginAsync(username, password).get();
+}
 
-        // Parse JSON array containing user info and fill the map
-        for (auto& el : jsonResult) {
-            int id = el["id"].get<int>();
-            std::string username = el["username"].get<std::string>();
-            users.insert({id, username});
-        }
+bool Backend::SendMessage(const std::string& username, const std::string& friendname, const std::string& message){
+    return SendMessageAsync(username, friendname, message).get().ok;
+}
 
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return users;
-    } catch (const std::exception& e) {
-        std::cout << e.what() << std::endl;
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        return {};
-    }
+ChatDelta Backend::GetChat(const std::string& username, const std::string& friendname, long long since){
+    return GetChatAsync(username, friendname, since).get();
+}
+
+ChatDelta Backend::GetChatPage(const std::string& username, const std::string& friendname, std::size_t limit, long long before){
+    return GetChatPageAsync(username, friendname, limit, before).get();
 }
 
+std::map<int, std::string> Backend::GetUsers(const std::string& username){
+    return GetUsersAsync(username).get();
+}
@@ -10,16 +10,79 @@
 
 #include <stdio.h>
 #include <iostream>
+#include <cstddef>
+#include <functional>
+#include <future>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
+#include "chat_message.hpp"
+#include "task.hpp"
+
+class HttpClient;
+
+/**
+ * Encoding requested for response payloads. The server may still answer
+ * in JSON, which is always understood.
+ */
+enum class WireFormat{
+    Json,
+    MessagePack
+};
+
+/**
+ * Chat messages newer than a cursor, plus the cursor to continue from.
+ */
+struct ChatDelta{
+    std::vector<ChatMessage> messages;  // Oldest first
+    long long cursor = 0;               // Highest sequence number seen
+    long long older = 0;                // For a page: pass as before to get the previous page, 0 if there is none
+    bool ok = true;                     // False if the request failed
+};
+
+/**
+ * Outcome of sending a message.
+ */
+struct SendReceipt{
+    bool ok = false;                    // True once the server stored the message
+    ChatMessage message;                // The stored copy; id is 0 if the server did not return one
+};
 
 class Backend{
 public:
     static bool Register(const std::string& username,const std::string& password);
     static bool Login(const std::string& username,const std::string& password);
     static bool SendMessage(const std::string& username,const std::string& friendname,const std::string& message);
-    static std::vector<std::pair<std::string, std::string>> GetChat(const std::string& username,const std::string& friendname);
+    static ChatDelta GetChat(const std::string& username,const std::string& friendname,long long since = 0);
+    static ChatDelta GetChatPage(const std::string& username,const std::string& friendname,std::size_t limit,long long before = 0);
     static std::map<int,std::string> GetUsers(const std::string& users);
+
+    // Non-blocking variants, completed by the shared HttpClient I/O thread
+    static std::future<bool> RegisterAsync(const std::string& username,const std::string& password);
+    static std::future<bool> LoginAsync(const std::string& username,const std::string& password);
+    static std::future<SendReceipt> SendMessageAsync(const std::string& username,const std::string& friendname,const std::string& message,const std::string& clientId = "");
+    static std::future<ChatDelta> GetChatAsync(const std::string& username,const std::string& friendname,long long since = 0);
+    static std::future<ChatDelta> GetChatPageAsync(const std::string& username,const std::string& friendname,std::size_t limit,long long before = 0);
+    static void GetChatPageAsync(const std::string& username,const std::string& friendname,std::size_t limit,long long before,std::function<void(ChatDelta)> complete);
+    static std::future<std::map<int,std::string>> GetUsersAsync(const std::string& username);
+
+    // Coroutine variants, for use with co_await inside a Task
+    static Awaitable<bool> RegisterCo(const std::string& username,const std::string& password);
+    static Awaitable<bool> LoginCo(const std::string& username,const std::string& password);
+    static Awaitable<SendReceipt> SendMessageCo(const std::string& username,const std::string& friendname,const std::string& message,const std::string& clientId = "");
+    static Awaitable<ChatDelta> GetChatCo(const std::string& username,const std::string& friendname,long long since = 0);
+    static Awaitable<std::map<int,std::string>> GetUsersCo(const std::string& username);
+
+    // Long-poll for messages newer than since; CancelWaits() aborts all of them until ResumeWaits()
+    static std::future<ChatDelta> WaitChatAsync(const std::string& username,const std::string& friendname,long long since,long timeoutMs);
+    static void WaitChatAsync(const std::string& username,const std::string& friendname,long long since,long timeoutMs,std::function<void(ChatDelta)> complete);
+    static void CancelWaits();
+    static void ResumeWaits();
+
+    static void UseClient(std::shared_ptr<HttpClient> client);
+    static void SetPoolSize(std::size_t size);
+    static void SetWireFormat(WireFormat format);
 };
 
 
@@ -0,0 +1,347 @@
+//
+//  chat_codec.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "chat_codec.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+namespace {
+
+enum class MessageField { None, Id, Sender, Recipient, Timestamp, Body, ClientId };
+
+// Integers the wire sends as floats must lie in [-TWO_TO_63, TWO_TO_63) to fit a long long
+const double TWO_TO_63 = 9223372036854775808.0;
+
+/**
+ * Maps a wire key to the ChatMessage field it fills.
+ * Dispatches on length first so most keys are rejected or matched with one compare.
+ */
+MessageField FieldFor(const std::string& key){
+    switch(key.size()){
+    case 3: return key == "seq" ? MessageField::Id : MessageField::None;
+    case 7: return key == "message" ? MessageField::Body : MessageField::None;
+    case 8: return key == "clientId" ? MessageField::ClientId : MessageField::None;
+    case 9: return key == "timestamp" ? MessageField::Timestamp : MessageField::None;
+    case 10:
+        if(key == "sendername") return MessageField::Sender;
+        if(key == "gettername") return MessageField::Recipient;
+        return MessageField::None;
+    default: return MessageField::None;
+    }
+}
+
+/**
+ * Reads an integer field that the wire may send as a float.
+ * Throws instead of casting a value a long long cannot hold.
+ */
+long long IntegerOf(const json& value){
+    if(value.is_number_float()){
+        double val = value.get<double>();
+        if(!std::isfinite(val) || val < -TWO_TO_63 || val >= TWO_TO_63){
+            throw std::invalid_argument("Chat message number out of range");
+        }
+    }
+    return value.get<long long>();
+}
+
+/**
+ * SAX handler decoding one message object directly into a ChatMessage.
+ * Unknown fields and nested values are skipped.
+ */
+struct MessageSax{
+    ChatMessage& out;
+    bool hasSender = false;
+    bool hasBody = false;
+    MessageField field = MessageField::None;
+    int depth = 0;
+
+    bool null() { field = MessageField::None; return true; }
+    bool boolean(bool) { field = MessageField::None; return true; }
+    bool number_integer(json::number_integer_t val) { return number(static_cast<long long>(val)); }
+    bool number_unsigned(json::number_unsigned_t val) { return number(static_cast<long long>(val)); }
+    bool number_float(json::number_float_t val, const std::string&){
+        // Casting NaN, infinity or anything a long long cannot hold is undefined; such a message is malformed
+        if(!std::isfinite(val) || val < -TWO_TO_63 || val >= TWO_TO_63) return false;
+        return number(static_cast<long long>(val));
+    }
+    bool binary(json::binary_t&) { field = MessageField::None; return true; }
+
+    bool string(std::string& val){
+        if(depth == 1){
+            switch(field){
+            case MessageField::Sender: out.sender = std::move(val); hasSender = true; break;
+            case MessageField::Recipient: out.recipient = std::move(val); break;
+            case MessageField::Body: out.body = std::move(val); hasBody = true; break;
+            case MessageField::ClientId: out.clientId = std::move(val); break;
+            default: break;
+            }
+        }
+        field = MessageField::None;
+        return true;
+    }
+
+    bool key(std::string& val){
+        field = depth == 1 ? FieldFor(val) : MessageField::None;
+        return true;
+    }
+
+    bool start_object(std::size_t) { depth++; field = MessageField::None; return true; }
+    bool end_object() { depth--; return true; }
+    bool start_array(std::size_t) { depth++; field = MessageField::None; return true; }
+    bool end_array() { depth--; return true; }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) { return false; }
+
+private:
+    bool number(long long val){
+        if(depth == 1){
+            if(field == MessageField::Id) out.id = val;
+            else if(field == MessageField::Timestamp) out.timestamp = val;
+        }
+        field = MessageField::None;
+        return true;
+    }
+};
+
+/**
+ * SAX handler for a whole array of message objects, used for MessagePack bodies.
+ * Each object is decoded by a MessageSax and appended to the delta.
+ */
+struct ChatArraySax{
+    ChatDelta& delta;
+    ChatMessage current;
+    MessageSax message{current};
+    std::size_t bytes;              // Size of the body, an upper bound on its element count
+    int depth = 0;
+    bool valid = true;
+
+    ChatArraySax(ChatDelta& delta, std::size_t bytes) : delta(delta), bytes(bytes){}
+
+    bool null() { return depth >= 2 ? message.null() : Unexpected(); }
+    bool boolean(bool val) { return depth >= 2 ? message.boolean(val) : Unexpected(); }
+    bool number_integer(json::number_integer_t val) { return depth >= 2 ? message.number_integer(val) : Unexpected(); }
+    bool number_unsigned(json::number_unsigned_t val) { return depth >= 2 ? message.number_unsigned(val) : Unexpected(); }
+    bool number_float(json::number_float_t val, const std::string& s) { return depth >= 2 ? message.number_float(val, s) : Unexpected(); }
+    bool string(std::string& val) { return depth >= 2 ? message.string(val) : Unexpected(); }
+    bool binary(json::binary_t& val) { return depth >= 2 ? message.binary(val) : Unexpected(); }
+    bool key(std::string& val) { return message.key(val); }
+
+    bool start_object(std::size_t elements){
+        if(depth == 0) return Unexpected();
+        if(depth == 1){
+            current = ChatMessage{};
+            message.hasSender = false;
+            message.hasBody = false;
+        }
+        depth++;
+        return message.start_object(elements);
+    }
+
+    bool end_object(){
+        depth--;
+        message.end_object();
+        if(depth == 1){
+            if(message.hasSender && message.hasBody){
+                delta.cursor = std::max(delta.cursor, current.id);
+                delta.messages.push_back(std::move(current));
+            } else {
+                std::cerr << "Invalid chat message format\n";
+            }
+        }
+        return true;
+    }
+
+    bool start_array(std::size_t elements){
+        if(depth == 1) return Unexpected();
+        // The count comes from the wire; every message takes at least one byte of the body
+        if(depth == 0 && elements != std::size_t(-1)) delta.messages.reserve(std::min(elements, bytes));
+        depth++;
+        return depth > 2 ? message.start_array(elements) : true;
+    }
+
+    bool end_array(){
+        depth--;
+        return depth >= 2 ? message.end_array() : true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) { return false; }
+
+private:
+    bool Unexpected() { valid = false; return false; }
+};
+
+}
+
+/**
+ * Reads a ChatMessage from its wire object in a single pass over its members.
+ * Throws if sendername or message is missing.
+ */
+void from_json(const json& j, ChatMessage& message){
+    bool hasSender = false;
+    bool hasBody = false;
+    for(auto& [key, value] : j.items()){
+        switch(FieldFor(key)){
+        case MessageField::Id: message.id = IntegerOf(value); break;
+        case MessageField::Sender: message.sender = value.get<std::string>(); hasSender = true; break;
+        case MessageField::Recipient: message.recipient = value.get<std::string>(); break;
+        case MessageField::Timestamp: message.timestamp = IntegerOf(value); break;
+        case MessageField::Body: message.body = value.get<std::string>(); hasBody = true; break;
+        case MessageField::ClientId: message.clientId = value.get<std::string>(); break;
+        case MessageField::None: break;
+        }
+    }
+    if(!hasSender || !hasBody){
+        throw std::invalid_argument("Invalid chat message format");
+    }
+}
+
+void to_json(json& j, const ChatMessage& message){
+    j = json{
+        {"seq", message.id},
+        {"sendername", message.sender},
+        {"gettername", message.recipient},
+        {"timestamp", message.timestamp},
+        {"message", message.body}
+    };
+    if(!message.clientId.empty()){
+        j["clientId"] = message.clientId;
+    }
+}
+
+/**
+ * Converts an array of chat messages, as sent by /get-chat, /wait-chat and
+ * WebSocket 'chat' frames, into a delta continuing from since.
+ *
+ * @param jsonResult JSON array of message objects.
+ * @param since Cursor the messages were requested with.
+ * @return Messages in server order and the highest sequence number seen.
+ */
+ChatDelta ParseChat(const json& jsonResult, long long since){
+    ChatDelta delta;
+    delta.cursor = since;
+    delta.messages.reserve(jsonResult.size());
+
+    for (auto& el : jsonResult) {
+        try {
+            ChatMessage message = el.get<ChatMessage>();
+            delta.cursor = std::max(delta.cursor, message.id);
+            delta.messages.push_back(std::move(message));
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+        }
+    }
+    return delta;
+}
+
+/**
+ * Delta returned when a chat request fails: nothing new, cursor unchanged.
+ */
+ChatDelta FailedChat(long long since){
+    ChatDelta delta;
+    delta.cursor = since;
+    delta.ok = false;
+    return delta;
+}
+
+ChatStreamDecoder::ChatStreamDecoder(long long since)
+    : format_(WireFormat::Json), depth_(0), inString_(false), escaped_(false), started_(false), finished_(false), failed_(false){
+    delta_.cursor = since;
+}
+
+/**
+ * Consumes the next chunk of the response body.
+ *
+ * @return False once the input is known to be malformed.
+ */
+bool ChatStreamDecoder::Feed(const char* data, std::size_t size){
+    if(format_ == WireFormat::MessagePack){
+        object_.append(data, size);
+        return true;
+    }
+
+    for(std::size_t i = 0; i < size && !failed_; i++){
+        char c = data[i];
+
+        if(depth_ >= 2) object_ += c;
+
+        if(inString_){
+            if(escaped_) escaped_ = false;
+            else if(c == '\\') escaped_ = true;
+            else if(c == '"') inString_ = false;
+            continue;
+        }
+
+        switch(c){
+        case '"':
+            if(depth_ < 2) failed_ = true; // Only objects are expected in the array
+            inString_ = true;
+            break;
+        case '[':
+        case '{':
+            if(depth_ == 0){
+                if(c != '[' || started_) failed_ = true;
+                started_ = true;
+            } else if(depth_ == 1){
+                if(c != '{') failed_ = true;
+                object_.assign(1, c);
+            }
+            depth_++;
+            break;
+        case ']':
+        case '}':
+            depth_--;
+            if(depth_ < 0) failed_ = true;
+            else if(depth_ == 1 && !DecodeObject()) failed_ = true;
+            else if(depth_ == 0) finished_ = true;
+            break;
+        case ' ': case '\n': case '\r': case '\t': case ',':
+            break;
+        default:
+            if(depth_ < 2) failed_ = true;
+        }
+    }
+    return !failed_;
+}
+
+/**
+ * Call once the body is complete.
+ *
+ * @return True if a whole, well-formed array was received.
+ */
+bool ChatStreamDecoder::Finish(){
+    if(format_ == WireFormat::MessagePack && !failed_){
+        ChatArraySax handler{delta_, object_.size()};
+        try {
+            finished_ = json::sax_parse(object_, &handler, nlohmann::detail::input_format_t::msgpack);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            failed_ = true;
+        }
+        object_.clear();
+    }
+    return !failed_ && finished_;
+}
+
+bool ChatStreamDecoder::DecodeObject(){
+    ChatMessage message;
+    MessageSax handler{message};
+
+    if(!json::sax_parse(object_, &handler)) return false;
+    object_.clear();
+
+    if(!handler.hasSender || !handler.hasBody){
+        std::cerr << "Invalid chat message format\n";
+        return true;
+    }
+    delta_.cursor = std::max(delta_.cursor, message.id);
+    delta_.messages.push_back(std::move(message));
+    return true;
+}
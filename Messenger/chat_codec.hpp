@@ -0,0 +1,60 @@
+//
+//  chat_codec.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef chat_codec_hpp
+#define chat_codec_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <string>
+#include "json-2.hpp"
+#include "backend.hpp"
+#include "chat_message.hpp"
+
+// Decoding of the chat message arrays shared by the HTTP and WebSocket transports
+
+// Wire schema of a ChatMessage; each key is matched once, without lookups into the object
+void from_json(const nlohmann::json& j, ChatMessage& message);
+void to_json(nlohmann::json& j, const ChatMessage& message);
+
+ChatDelta ParseChat(const nlohmann::json& jsonResult, long long since);
+ChatDelta FailedChat(long long since);
+
+/**
+ * Incremental decoder for an array of chat messages.
+ *
+ * Fed chunk by chunk straight from the libcurl write callback, it keeps at
+ * most one JSON message object in its buffer and decodes each one with a SAX
+ * handler into the result as soon as its closing brace arrives, so neither
+ * the whole response body nor a JSON DOM is ever held in memory.
+ * MessagePack bodies are compact enough to be buffered and are decoded by
+ * the same SAX path in Finish().
+ */
+class ChatStreamDecoder{
+public:
+    explicit ChatStreamDecoder(long long since);
+
+    void SetFormat(WireFormat format) { format_ = format; }
+    bool Feed(const char* data, std::size_t size);
+    bool Finish();
+    ChatDelta Take() { return std::move(delta_); }
+
+private:
+    bool DecodeObject();
+
+    ChatDelta delta_;
+    WireFormat format_;
+    std::string object_;    // JSON: bytes of the message object being received; MessagePack: whole body
+    int depth_;             // Nesting depth, 1 = inside the top-level array
+    bool inString_;
+    bool escaped_;
+    bool started_;          // Saw the opening '['
+    bool finished_;         // Saw the closing ']'
+    bool failed_;
+};
+
+#endif /* chat_codec_hpp */
@@ -0,0 +1,27 @@
+//
+//  chat_message.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef chat_message_hpp
+#define chat_message_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+
+/**
+ * One stored chat message as sent by the server.
+ */
+struct ChatMessage{
+    long long id = 0;               // Server-assigned sequence number ("seq" on the wire)
+    std::string sender;             // "sendername"
+    std::string recipient;          // "gettername"
+    std::int64_t timestamp = 0;     // Milliseconds since the Unix epoch ("timestamp")
+    std::string body;               // Decrypted text ("message")
+    std::string clientId;           // Id the sender's outbox gave it, empty if none ("clientId"); not kept in ChatStore
+};
+
+#endif /* chat_message_hpp */
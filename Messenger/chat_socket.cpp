@@ -0,0 +1,196 @@
+//
+//  chat_socket.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "chat_socket.hpp"
+#include <iostream>
+#include "json-2.hpp"
+#include "chat_codec.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+std::map<int, std::string> ParseUsers(const json& jsonResult){
+    std::map<int, std::string> users;
+    for (auto& el : jsonResult) {
+        users.insert({el["id"].get<int>(), el["username"].get<std::string>()});
+    }
+    return users;
+}
+
+}
+
+ChatSocket::ChatSocket() : cursor_(0), nextRef_(1), closed_(true){}
+
+ChatSocket::~ChatSocket(){
+    Close();
+}
+
+/**
+ * Opens the WebSocket and introduces the user to the server.
+ *
+ * @param username Current user; all later frames act on their behalf.
+ * @return True if the connection is open.
+ */
+bool ChatSocket::Connect(const std::string& username, const std::string& host, int port){
+    Close();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = false;
+        chats_.clear();
+    }
+    bool open = socket_.Connect(host, port, "/ws",
+        [this](std::string&& text){ OnMessage(std::move(text)); },
+        [this](){ OnClose(); });
+    if(!open){
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        return false;
+    }
+
+    json j;
+    j["type"] = "hello";
+    j["username"] = username;
+    return socket_.SendText(j.dump());
+}
+
+/**
+ * Closes the connection. Pending calls fail and NextChat() returns ok == false.
+ */
+void ChatSocket::Close(){
+    socket_.Close();
+    OnClose();
+}
+
+/**
+ * Starts receiving messages of the conversation with friendname.
+ * The server first pushes everything newer than since, then each new message.
+ *
+ * @param limit With since = 0, only the newest limit messages are pushed first;
+ *              older ones are left to Backend::GetChatPage. 0 pushes the whole chat.
+ * @return False if the frame could not be sent.
+ */
+bool ChatSocket::Subscribe(const std::string& friendname, long long since, std::size_t limit){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cursor_ = since;
+        chats_.clear();
+    }
+    json j;
+    j["type"] = "subscribe";
+    j["friendname"] = friendname;
+    j["since"] = since;
+    if(limit > 0){
+        j["limit"] = limit;
+    }
+    return socket_.SendText(j.dump());
+}
+
+/**
+ * Blocks until the server pushes new chat messages or the connection closes.
+ *
+ * @return Pushed messages; ok == false once the connection is closed.
+ */
+ChatDelta ChatSocket::NextChat(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    chatReady_.wait(lock, [this](){ return !chats_.empty() || closed_; });
+    if(chats_.empty()) return FailedChat(cursor_);
+
+    ChatDelta delta = std::move(chats_.front());
+    chats_.pop_front();
+    return delta;
+}
+
+/**
+ * Sends a message as a single frame.
+ *
+ * @param clientId Optional id the server uses to ignore resends of the same message.
+ * @return Future resolving once the server acknowledged storing it, with the stored copy.
+ */
+std::future<SendReceipt> ChatSocket::SendMessageAsync(const std::string& friendname, const std::string& message, const std::string& clientId){
+    std::promise<SendReceipt> promise;
+    std::future<SendReceipt> future = promise.get_future();
+
+    json j;
+    j["type"] = "send";
+    j["friendname"] = friendname;
+    j["message"] = message;
+    if(!clientId.empty()){
+        j["clientId"] = clientId;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(closed_){
+            promise.set_value(SendReceipt{});
+            return future;
+        }
+        j["ref"] = nextRef_;
+        pendingSends_.emplace(nextRef_++, std::move(promise));
+    }
+
+    if(!socket_.SendText(j.dump())){
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pendingSends_.find(j["ref"].get<std::uint64_t>());
+        if(it != pendingSends_.end()){
+            it->second.set_value(SendReceipt{});
+            pendingSends_.erase(it);
+        }
+    }
+    return future;
+}
+
+/**
+ * Latest user list, kept current by the server's pushes.
+ */
+std::map<int,std::string> ChatSocket::Users(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return users_;
+}
+
+/**
+ * Dispatches a frame from the server (runs on the WebSocket reader thread).
+ */
+void ChatSocket::OnMessage(std::string&& text){
+    try {
+        json frame = json::parse(text);
+        std::string type = frame.value("type", "");
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(type == "chat"){
+            ChatDelta delta = ParseChat(frame["messages"], cursor_);
+            cursor_ = delta.cursor;
+            chats_.push_back(std::move(delta));
+            chatReady_.notify_all();
+        } else if(type == "ack"){
+            auto it = pendingSends_.find(frame["ref"].get<std::uint64_t>());
+            if(it != pendingSends_.end()){
+                SendReceipt receipt;
+                receipt.ok = frame.value("success", false);
+                if(receipt.ok && frame.contains("message") && frame["message"].is_object()){
+                    receipt.message = frame["message"].get<ChatMessage>();
+                }
+                it->second.set_value(std::move(receipt));
+                pendingSends_.erase(it);
+            }
+        } else if(type == "users"){
+            // Pushed after someone registered
+            users_ = ParseUsers(frame["users"]);
+        }
+    } catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+    }
+}
+
+void ChatSocket::OnClose(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    for(auto& [ref, promise] : pendingSends_){
+        promise.set_value(SendReceipt{});
+    }
+    pendingSends_.clear();
+    chatReady_.notify_all();
+}
@@ -0,0 +1,62 @@
+//
+//  chat_socket.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef chat_socket_hpp
+#define chat_socket_hpp
+
+#include <stdio.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include "backend.hpp"
+#include "websocket.hpp"
+
+/**
+ * Optional WebSocket transport to the server's /ws endpoint.
+ *
+ * One long-lived connection carries sends, chat updates and user list
+ * changes as small JSON frames, instead of one HTTP request per operation.
+ * Chat updates are pushed by the server after Subscribe() and picked up
+ * with NextChat().
+ */
+class ChatSocket{
+public:
+    ChatSocket();
+    ~ChatSocket();
+
+    bool Connect(const std::string& username, const std::string& host = "127.0.0.1", int port = 4040);
+    void Close();
+    bool IsOpen() const { return socket_.IsOpen(); }
+
+    bool Subscribe(const std::string& friendname, long long since, std::size_t limit = 0);
+    ChatDelta NextChat();
+
+    std::future<SendReceipt> SendMessageAsync(const std::string& friendname, const std::string& message, const std::string& clientId = "");
+    std::map<int,std::string> Users();
+
+private:
+    void OnMessage(std::string&& text);
+    void OnClose();
+
+    WebSocket socket_;
+
+    std::mutex mutex_;
+    std::condition_variable chatReady_;
+    std::deque<ChatDelta> chats_;                                   // Pushed and not yet taken by NextChat()
+    long long cursor_;                                              // Highest sequence number received
+    std::map<std::uint64_t, std::promise<SendReceipt>> pendingSends_;      // Keyed by frame ref
+    std::map<int,std::string> users_;                               // Latest list pushed by the server
+    std::uint64_t nextRef_;
+    bool closed_;
+};
+
+#endif /* chat_socket_hpp */
@@ -0,0 +1,316 @@
+//
+//  chat_store.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "chat_store.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+#ifdef MAP_POPULATE
+const int MAP_FLAGS = MAP_PRIVATE | MAP_POPULATE; // Fault the whole log in with one call
+#else
+const int MAP_FLAGS = MAP_PRIVATE;
+#endif
+
+// First bytes of every log file, bumped if the record layout changes
+const char MAGIC[8] = {'T', 'M', 'C', 'H', 'A', 'T', '0', '1'};
+
+/**
+ * Fixed part of a log record, followed by the sender, recipient and body bytes.
+ * Stored in host byte order: the log never leaves the machine that wrote it.
+ */
+struct RecordHeader{
+    std::uint32_t size;             // Whole record including this header
+    std::uint32_t checksum;         // FNV-1a of everything after this field
+    std::int64_t id;
+    std::int64_t timestamp;
+    std::uint32_t senderSize;
+    std::uint32_t recipientSize;
+    std::uint32_t bodySize;
+    std::uint32_t reserved;
+};
+
+std::uint32_t Checksum(const char* data, std::size_t size){
+    std::uint32_t hash = 2166136261u;
+    for(std::size_t i = 0; i < size; i++){
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Creates path and its missing parents, like mkdir -p.
+ */
+bool MakeDirectories(const std::string& path){
+    for(std::size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)){
+        std::string part = path.substr(0, slash);
+        if(mkdir(part.c_str(), 0700) != 0 && errno != EEXIST) return false;
+        if(slash == std::string::npos) return true;
+    }
+}
+
+/**
+ * Makes a user name safe to use as a file name.
+ */
+std::string FileName(const std::string& name){
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for(unsigned char c : name){
+        if(std::isalnum(c) || c == '-' || c == '_'){
+            out += c;
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+    return out;
+}
+
+/**
+ * Decodes a record that has already been validated.
+ */
+ChatMessage DecodeRecord(const char* record){
+    RecordHeader header;
+    std::memcpy(&header, record, sizeof(header));
+    const char* text = record + sizeof(RecordHeader);
+
+    ChatMessage message;
+    message.id = header.id;
+    message.timestamp = header.timestamp;
+    message.sender.assign(text, header.senderSize);
+    message.recipient.assign(text + header.senderSize, header.recipientSize);
+    message.body.assign(text + header.senderSize + header.recipientSize, header.bodySize);
+    return message;
+}
+
+void AppendRecord(std::string& out, const ChatMessage& message){
+    RecordHeader header{};
+    header.size = sizeof(RecordHeader) + message.sender.size() + message.recipient.size() + message.body.size();
+    header.id = message.id;
+    header.timestamp = message.timestamp;
+    header.senderSize = message.sender.size();
+    header.recipientSize = message.recipient.size();
+    header.bodySize = message.body.size();
+
+    std::size_t start = out.size();
+    out.append((const char*)&header, sizeof(header));
+    out += message.sender;
+    out += message.recipient;
+    out += message.body;
+
+    std::size_t checked = offsetof(RecordHeader, checksum) + sizeof(header.checksum);
+    header.checksum = Checksum(out.data() + start + checked, header.size - checked);
+    std::memcpy(&out[start + offsetof(RecordHeader, checksum)], &header.checksum, sizeof(header.checksum));
+}
+
+}
+
+/**
+ * Directory holding the chat logs: $MESSENGER_DATA_DIR if set, otherwise
+ * terminal-messenger under $XDG_DATA_HOME or ~/.local/share.
+ */
+std::string ChatStore::DataDirectory(){
+    if(const char* dir = std::getenv("MESSENGER_DATA_DIR")) return dir;
+    if(const char* dir = std::getenv("XDG_DATA_HOME")) return std::string(dir) + "/terminal-messenger";
+    const char* home = std::getenv("HOME");
+    return std::string(home ? home : ".") + "/.local/share/terminal-messenger";
+}
+
+/**
+ * Directory holding the local files of one user, created if missing.
+ *
+ * @return Path of the directory, or an empty string if it cannot be created.
+ */
+std::string ChatStore::UserDirectory(const std::string& username){
+    std::string dir = DataDirectory() + "/" + FileName(username);
+    return MakeDirectories(dir) ? dir : "";
+}
+
+/**
+ * Opens (creating if needed) the log of the conversation between username and friendname.
+ * Check IsOpen(): without a usable data directory the store stays empty.
+ *
+ * @param username Logged-in user; each local user has their own logs.
+ * @param friendname Other chat participant.
+ */
+ChatStore::ChatStore(const std::string& username, const std::string& friendname) : fd_(-1), lastId_(0){
+    std::string dir = UserDirectory(username);
+    if(dir.empty()) return;
+    path_ = dir + "/" + FileName(friendname) + ".log";
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0600);
+}
+
+ChatStore::~ChatStore(){
+    if(fd_ >= 0) close(fd_);
+}
+
+/**
+ * Checks the whole log and decodes its newest messages; older ones stay on
+ * disk for Read(). Must be called before Append().
+ *
+ * @param newest How many of the latest messages to decode, all by default.
+ * @return Those messages in order, with the cursor to continue fetching from.
+ */
+ChatDelta ChatStore::Load(std::size_t newest){
+    ChatDelta delta;
+    offsets_.clear();
+    if(fd_ < 0) return delta;
+    flock(fd_, LOCK_EX);
+
+    struct stat info{};
+    fstat(fd_, &info);
+    std::size_t size = info.st_size;
+    std::size_t valid = 0;
+
+    if(size < sizeof(MAGIC)){
+        // New log, or one whose first write never completed
+        if(ftruncate(fd_, 0) == 0 && write(fd_, MAGIC, sizeof(MAGIC)) == (ssize_t)sizeof(MAGIC)){
+            valid = size = sizeof(MAGIC);
+        }
+    } else {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_FLAGS, fd_, 0);
+        if(mapped != MAP_FAILED){
+            const char* data = (const char*)mapped;
+            if(std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0){
+                valid = sizeof(MAGIC);
+                std::size_t checked = offsetof(RecordHeader, checksum) + sizeof(std::uint32_t);
+                offsets_.reserve(size / (sizeof(RecordHeader) + 32));
+
+                // Validate and index every record first; only the newest get decoded
+                while(valid + sizeof(RecordHeader) <= size){
+                    RecordHeader header;
+                    std::memcpy(&header, data + valid, sizeof(header));
+                    std::uint64_t fields = (std::uint64_t)header.senderSize + header.recipientSize + header.bodySize;
+                    if(header.size != sizeof(RecordHeader) + fields || header.size > size - valid) break;
+                    if(header.checksum != Checksum(data + valid + checked, header.size - checked)) break;
+
+                    std::size_t offset = valid;
+                    valid += header.size;
+
+                    // Two clients of the same user may both have stored a message
+                    if(header.id <= delta.cursor) continue;
+                    delta.cursor = header.id;
+                    offsets_.push_back(offset);
+                }
+
+                std::size_t first = offsets_.size() > newest ? offsets_.size() - newest : 0;
+                delta.messages.reserve(offsets_.size() - first);
+                for(std::size_t i = first; i < offsets_.size(); i++){
+                    delta.messages.push_back(DecodeRecord(data + offsets_[i]));
+                }
+            }
+            munmap(mapped, size);
+        }
+    }
+
+    if(valid == 0){
+        // Not a log written by this version; leave it alone and keep nothing
+        flock(fd_, LOCK_UN);
+        close(fd_);
+        fd_ = -1;
+        offsets_.clear();
+        delta.messages.clear();
+        delta.cursor = 0;
+        return delta;
+    }
+    // A record torn by a crash must go, or later appends would be unreadable
+    bool writable = valid == size || ftruncate(fd_, valid) == 0;
+    flock(fd_, LOCK_UN);
+    if(!writable){
+        close(fd_);
+        fd_ = -1;
+    }
+
+    lastId_ = delta.cursor;
+    return delta;
+}
+
+/**
+ * Appends messages newer than the last stored one with a single write.
+ *
+ * @param messages Messages in ascending id order, e.g. from a ChatDelta.
+ * @return False if the log could not be written, or was dropped because a message had no id.
+ */
+bool ChatStore::Append(const std::vector<ChatMessage>& messages){
+    if(fd_ < 0) return false;
+
+    // A server that has not numbered its older messages yet sends them with id 0. The
+    // log resumes by id and would lose them for good, so it is removed and not used
+    // again; the next run fetches the whole chat from the server.
+    bool numbered = std::all_of(messages.begin(), messages.end(), [](const ChatMessage& message){ return message.id > 0; });
+    if(!numbered){
+        unlink(path_.c_str());
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    std::string records;
+    std::vector<std::uint64_t> starts;
+    long long last = lastId_;
+    for(const ChatMessage& message : messages){
+        if(message.id <= last) continue;
+        starts.push_back(records.size());
+        AppendRecord(records, message);
+        last = message.id;
+    }
+    if(records.empty()) return true;
+
+    // Another client of the same user may be appending to this log too
+    flock(fd_, LOCK_EX);
+    off_t end = lseek(fd_, 0, SEEK_END);
+    bool written = end >= 0 && write(fd_, records.data(), records.size()) == (ssize_t)records.size();
+    flock(fd_, LOCK_UN);
+    if(written){
+        lastId_ = last;
+        for(std::uint64_t start : starts){
+            offsets_.push_back(end + start);
+        }
+    }
+    return written;
+}
+
+/**
+ * Reads stored messages back from disk, e.g. to show history that Load()
+ * did not decode.
+ *
+ * @param first Position of the first message, 0 being the oldest stored one.
+ * @param count Number of messages to read; fewer are returned past Count().
+ * @return The messages in order, or none if the log cannot be read.
+ */
+std::vector<ChatMessage> ChatStore::Read(std::size_t first, std::size_t count){
+    std::vector<ChatMessage> messages;
+    if(fd_ < 0 || count == 0 || first >= offsets_.size()) return messages;
+    count = std::min(count, offsets_.size() - first);
+
+    // One read covers the whole range; the last record's header tells where it ends
+    std::uint64_t start = offsets_[first];
+    RecordHeader last;
+    if(pread(fd_, &last, sizeof(last), offsets_[first + count - 1]) != (ssize_t)sizeof(last)) return messages;
+    std::uint64_t end = offsets_[first + count - 1] + last.size;
+
+    std::string data(end - start, '\0');
+    if(pread(fd_, &data[0], data.size(), start) != (ssize_t)data.size()) return messages;
+
+    messages.reserve(count);
+    for(std::size_t i = first; i < first + count; i++){
+        messages.push_back(DecodeRecord(data.data() + (offsets_[i] - start)));
+    }
+    return messages;
+}
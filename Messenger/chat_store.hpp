@@ -0,0 +1,52 @@
+//
+//  chat_store.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef chat_store_hpp
+#define chat_store_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "backend.hpp"
+#include "chat_message.hpp"
+
+/**
+ * On-disk history of one conversation, kept between runs.
+ *
+ * Messages are stored in an append-only log file per conversation under
+ * DataDirectory(). Load() maps the file and decodes it in one pass, so a chat
+ * can be drawn before any request is made, and only messages past the stored
+ * cursor need to be fetched. A record torn by a crash is dropped on load.
+ * Load() can decode just the newest messages and keep an index of the rest,
+ * which Read() fetches from disk when the user scrolls back.
+ */
+class ChatStore{
+public:
+    ChatStore(const std::string& username, const std::string& friendname);
+    ~ChatStore();
+
+    ChatStore(const ChatStore&) = delete;
+    ChatStore& operator=(const ChatStore&) = delete;
+
+    bool IsOpen() const { return fd_ >= 0; }
+    ChatDelta Load(std::size_t newest = SIZE_MAX);
+    bool Append(const std::vector<ChatMessage>& messages);
+    std::vector<ChatMessage> Read(std::size_t first, std::size_t count);
+    std::size_t Count() const { return offsets_.size(); }
+
+    static std::string DataDirectory();
+    static std::string UserDirectory(const std::string& username);
+
+private:
+    int fd_;
+    std::string path_;
+    long long lastId_;      // Highest stored message id, valid after Load()
+    std::vector<std::uint64_t> offsets_;   // File offset of every stored message, oldest first
+};
+
+#endif /* chat_store_hpp */
@@ -0,0 +1,372 @@
+//
+//  chat_view.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "chat_view.hpp"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include "latency_histogram.hpp"
+#include "trace.hpp"
+#include "probes.hpp"
+
+namespace {
+
+// Stored messages decoded up front; older ones are read from disk when scrolled to
+const std::size_t HISTORY_IN_MEMORY = 2000;
+
+}
+
+ChatView::ChatView(const std::string& username, ChatStore& store, ScreenRenderer& screen)
+    : username_(username), store_(store), screen_(screen), base_(0), top_(0), topRow_(0), following_(true), fetching_(false), exhausted_(false){}
+
+/**
+ * Loads the stored history and shows its end.
+ */
+void ChatView::LoadHistory(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    ChatDelta delta = store_.Load(HISTORY_IN_MEMORY);
+    base_ = store_.Count() - delta.messages.size();
+    conversation_.Append(std::move(delta));
+    Draw();
+}
+
+/**
+ * Saves a delta to the store and adds it to the view. A message of this
+ * user that is still pending, because the delta came before the send
+ * receipt, is matched by its clientId and shown only once.
+ *
+ * @param delta Result of a request made with Cursor().
+ * @return True if any message was added.
+ */
+bool ChatView::Append(ChatDelta&& delta){
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool settled = false;
+    for(const ChatMessage& message : delta.messages){
+        if(message.clientId.empty() || message.sender != username_) continue;
+        auto found = pendingIds_.find(message.clientId);
+        if(found == pendingIds_.end()) continue;
+        pending_.erase(found->second);
+        pendingIds_.erase(found);
+        settled = true;
+    }
+
+    store_.Append(delta.messages);
+    bool added = conversation_.Append(std::move(delta));
+    // Scrolled back, nothing on screen moves; at the bottom the new messages show up
+    if((added || settled) && following_) Draw();
+    return added;
+}
+
+/**
+ * Shows a message as pending the moment it is queued for sending.
+ *
+ * @param clientId Id the outbox tracks the message by.
+ * @param body Text of the message.
+ */
+void ChatView::AddPending(const std::string& clientId, const std::string& body){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(pendingIds_.count(clientId)) return;
+    pendingIds_[clientId] = pending_.insert(pending_.end(), Pending{body});
+    if(following_) Draw();
+}
+
+/**
+ * Applies the server's answer to a pending message. A stored message takes
+ * its place in the conversation before any delta brings it; the store gets
+ * it with that delta. A failed attempt stays on screen, marked as retrying.
+ * Nothing changes if a delta already brought the message.
+ *
+ * @param clientId Id given to AddPending().
+ * @param receipt Result of one send attempt.
+ */
+void ChatView::Settle(const std::string& clientId, const SendReceipt& receipt){
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = pendingIds_.find(clientId);
+    if(!receipt.ok){
+        if(found == pendingIds_.end() || found->second->failed) return;
+        found->second->failed = true;
+    } else {
+        if(found != pendingIds_.end()){
+            pending_.erase(found->second);
+            pendingIds_.erase(found);
+        }
+        // An older server does not send the message back; the next delta brings it
+        if(receipt.message.id != 0) conversation_.Insert(receipt.message);
+    }
+    if(following_) Draw();
+}
+
+long long ChatView::Cursor(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return conversation_.Cursor();
+}
+
+/**
+ * Sets how to request history older than the oldest message known here.
+ * Without it, scrolling stops at the start of the stored history.
+ */
+void ChatView::SetBackfill(Fetch fetch){
+    std::lock_guard<std::mutex> lock(mutex_);
+    fetch_ = std::move(fetch);
+}
+
+/**
+ * Puts a page requested through the backfill function in front of the
+ * history, keeping the rows on screen where they are.
+ *
+ * @param page Messages older than the ones shown, from Backend::GetChatPage.
+ */
+void ChatView::Backfill(ChatDelta&& page){
+    std::lock_guard<std::mutex> lock(mutex_);
+    fetching_ = false;
+    if(!page.ok) return; // Tried again on the next PageUp
+    if(page.older == 0) exhausted_ = true;
+
+    // Only messages before the oldest known one; a server that has not
+    // numbered its old messages yet sends unnumbered (id 0) ones or the
+    // same page again, which would otherwise repeat without end
+    long long oldest = OldestId();
+    auto known = std::find_if(page.messages.begin(), page.messages.end(), [oldest](const ChatMessage& message){
+        return message.id <= 0 || message.id >= oldest;
+    });
+    if(known != page.messages.end()){
+        page.messages.erase(known, page.messages.end());
+        exhausted_ = true;
+    }
+    if(page.messages.empty()) return;
+
+    older_.insert(older_.begin(), std::make_move_iterator(page.messages.begin()), std::make_move_iterator(page.messages.end()));
+    if(!following_){
+        top_ += page.messages.size();
+        Draw();
+    }
+}
+
+/**
+ * Scrolls back one screen, keeping one row of the previous screen for context.
+ * Nearing the oldest known message starts fetching the page before it.
+ */
+void ChatView::PageUp(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t rows = screen_.Rows();
+    if(top_ > 0 || topRow_ > 0){
+        std::size_t up = rows > 1 ? rows - 1 : 1;
+        if(topRow_ >= up){
+            topRow_ -= up;
+        } else {
+            // Every message takes at least one row, so no more than up of them are passed
+            up -= topRow_;
+            std::size_t first = top_ > up ? top_ - up : 0;
+            std::vector<std::string> lines = Lines(first, top_);
+            topRow_ = 0;
+            while(top_ > first && up > 0){
+                top_--;
+                std::size_t height = screen_.Wrap(lines[top_ - first]).size();
+                if(height >= up){
+                    topRow_ = height - up;
+                    up = 0;
+                } else {
+                    up -= height;
+                }
+            }
+        }
+        following_ = false;
+        Draw();
+    }
+    // Ask early, so the page is usually here by the time the user scrolls to it
+    if(top_ < 2 * rows) FetchOlder();
+}
+
+/**
+ * Scrolls forward one screen; reaching the end follows new messages again.
+ */
+void ChatView::PageDown(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(following_) return;
+
+    std::size_t rows = screen_.Rows();
+    std::size_t step = rows > 1 ? rows - 1 : 1;
+    std::size_t total = Total();
+    // Enough messages to move step rows and tell whether a screenful is left after that
+    std::size_t last = std::min(total, top_ + step + rows + 1);
+    std::vector<std::string> lines = Lines(top_, last);
+    std::vector<std::size_t> heights;
+    heights.reserve(lines.size());
+    for(const std::string& line : lines) heights.push_back(screen_.Wrap(line).size());
+
+    std::size_t down = topRow_ + step;
+    std::size_t i = 0;
+    while(i < heights.size() && down >= heights[i]){
+        down -= heights[i];
+        i++;
+    }
+    top_ += i;
+    topRow_ = i < heights.size() ? down : 0;
+
+    std::size_t left = 0;
+    for(std::size_t j = i; j < heights.size(); j++) left += heights[j];
+    if(last == total && left - topRow_ <= rows) following_ = true;
+    Draw();
+}
+
+/**
+ * Draws the current rows again, e.g. after the terminal was resized.
+ */
+void ChatView::Redraw(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Draw();
+}
+
+/**
+ * Shows lines over the bottom rows of the chat, e.g. a report, until ClosePanel().
+ */
+void ChatView::ShowPanel(std::vector<std::string> lines){
+    std::lock_guard<std::mutex> lock(mutex_);
+    panel_ = std::move(lines);
+    Draw();
+}
+
+void ChatView::ClosePanel(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(panel_.empty()) return;
+    panel_.clear();
+    Draw();
+}
+
+std::size_t ChatView::Total() const{
+    return older_.size() + base_ + conversation_.Messages().size() + pending_.size();
+}
+
+/**
+ * Requests the page before the oldest known message unless one is on its
+ * way or the server has none. Called with mutex_ held.
+ */
+void ChatView::FetchOlder(){
+    if(!fetch_ || fetching_ || exhausted_) return;
+
+    long long oldest = OldestId();
+    // Nothing known yet, the first sync brings the newest page
+    if(oldest <= 0) return;
+
+    fetching_ = true;
+    fetch_(oldest);
+}
+
+/**
+ * Sequence number of the oldest message known here. Called with mutex_ held.
+ *
+ * @return 0 if there is none.
+ */
+long long ChatView::OldestId(){
+    if(!older_.empty()){
+        return older_.front().id;
+    } else if(base_ > 0){
+        std::vector<ChatMessage> first = store_.Read(0, 1);
+        if(!first.empty()) return first.front().id;
+    } else if(!conversation_.Messages().empty()){
+        return conversation_.Messages().front().id;
+    }
+    return 0;
+}
+
+/**
+ * Formats the messages at positions [first, last), one line each. Called
+ * with mutex_ held.
+ */
+std::vector<std::string> ChatView::Lines(std::size_t first, std::size_t last){
+    std::vector<std::string> lines;
+    lines.reserve(last > first ? last - first : 0);
+    auto addLine = [&](const ChatMessage& message){
+        lines.push_back((message.sender == username_ ? "me" : message.sender) + "> " + message.body);
+    };
+
+    // Positions run through the fetched pages, the stored history on disk, the conversation, then pending sends
+    std::size_t stored = older_.size();
+    std::size_t recent = stored + base_;
+    for(std::size_t i = first; i < std::min(last, stored); i++){
+        addLine(older_[i]);
+    }
+    std::size_t from = std::max(first, stored);
+    std::size_t to = std::min(last, recent);
+    if(from < to){
+        for(const ChatMessage& message : store_.Read(from - stored, to - from)){
+            addLine(message);
+        }
+    }
+    const std::vector<ChatMessage>& messages = conversation_.Messages();
+    std::size_t confirmed = recent + messages.size();
+    for(std::size_t i = std::max(first, recent); i < std::min(last, confirmed); i++){
+        addLine(messages[i - recent]);
+    }
+    auto pending = pending_.begin();
+    for(std::size_t i = confirmed; i < last; i++, pending++){
+        if(i < first) continue;
+        lines.push_back((pending->failed ? "me (not sent, retrying)> " : "me (sending)> ") + pending->body);
+    }
+    return lines;
+}
+
+/**
+ * Formats and renders the visible rows only. Called with mutex_ held.
+ */
+void ChatView::Draw(){
+    LatencyTimer timer(ChatLatency::Shared().render);
+    TraceSpan span("ui", "render");
+    unsigned long long probeStart = MESSENGER_PROBE_NOW(render_end);
+    std::size_t rows = screen_.Rows();
+    MESSENGER_PROBE1(render_start, rows);
+    std::size_t total = Total();
+
+    // Every message takes at least one row, so no more than rows of them are ever needed
+    std::vector<std::string> shown;
+    if(following_){
+        // The newest messages, the oldest of them possibly cut at the top
+        std::size_t first = total > rows ? total - rows : 0;
+        std::vector<std::string> lines = Lines(first, total);
+        std::vector<std::vector<std::string>> wrapped;
+        std::size_t count = 0;
+        std::size_t position = total;
+        while(position > first && count < rows){
+            position--;
+            wrapped.push_back(screen_.Wrap(lines[position - first]));
+            count += wrapped.back().size();
+        }
+        top_ = position;
+        topRow_ = count > rows ? count - rows : 0;
+        for(auto message = wrapped.rbegin(); message != wrapped.rend(); message++){
+            shown.insert(shown.end(), message->begin(), message->end());
+        }
+        shown.erase(shown.begin(), shown.begin() + topRow_);
+    } else {
+        top_ = std::min(top_, total);
+        std::vector<std::string> lines = Lines(top_, std::min(total, top_ + rows));
+        std::size_t skip = topRow_;
+        for(const std::string& line : lines){
+            for(std::string& row : screen_.Wrap(line)){
+                if(skip > 0){
+                    skip--;
+                } else if(shown.size() < rows){
+                    shown.push_back(std::move(row));
+                }
+            }
+            if(shown.size() == rows) break;
+        }
+    }
+
+    if(!panel_.empty()){
+        std::vector<std::string> panel;
+        for(const std::string& line : panel_){
+            std::vector<std::string> wrapped = screen_.Wrap(line);
+            panel.insert(panel.end(), wrapped.begin(), wrapped.end());
+        }
+        shown.resize(rows);
+        std::size_t covered = std::min(panel.size(), rows);
+        std::copy(panel.begin(), panel.begin() + covered, shown.end() - covered);
+    }
+    screen_.Render(shown);
+    MESSENGER_PROBE2(render_end, rows, MESSENGER_PROBE_NOW(render_end) - probeStart);
+}
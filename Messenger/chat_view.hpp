@@ -0,0 +1,91 @@
+//
+//  chat_view.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef chat_view_hpp
+#define chat_view_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "chat_store.hpp"
+#include "conversation.hpp"
+#include "screen_renderer.hpp"
+
+/**
+ * Scrollable window onto one conversation.
+ *
+ * Only the rows that fit on screen are formatted and drawn, so a redraw
+ * costs the same for ten messages or a million. Messages wider than the
+ * screen wrap onto several rows, and scrolling moves by rows. Recent messages are kept
+ * in memory; older stored history is read from the ChatStore page by page
+ * as the user scrolls back to it, and history older than anything stored
+ * is requested from the server through the backfill function. New
+ * messages keep the view at the bottom unless the user scrolled up.
+ * Messages being sent show below the chat, marked pending, until the
+ * server stores them. Safe to call from several threads.
+ */
+class ChatView{
+public:
+    // Requests the page before the given message id; the result goes to Backfill()
+    using Fetch = std::function<void(long long before)>;
+
+    ChatView(const std::string& username, ChatStore& store, ScreenRenderer& screen);
+
+    void LoadHistory();
+    bool Append(ChatDelta&& delta);
+    void AddPending(const std::string& clientId, const std::string& body);
+    void Settle(const std::string& clientId, const SendReceipt& receipt);
+    long long Cursor();
+
+    void SetBackfill(Fetch fetch);
+    void Backfill(ChatDelta&& page);
+
+    void PageUp();
+    void PageDown();
+    void Redraw();
+
+    void ShowPanel(std::vector<std::string> lines);
+    void ClosePanel();
+
+private:
+    // A sent message the server has not stored yet
+    struct Pending{
+        std::string body;
+        bool failed = false;        // Last attempt failed, the outbox tries again
+    };
+
+    void Draw();
+    void FetchOlder();
+    long long OldestId();
+    std::size_t Total() const;
+    std::vector<std::string> Lines(std::size_t first, std::size_t last);
+
+    std::mutex mutex_;
+    std::string username_;
+    ChatStore& store_;
+    ScreenRenderer& screen_;
+    Conversation conversation_;     // Newest messages, kept in memory
+    std::deque<ChatMessage> older_; // Pages fetched from the server, older than anything stored
+    std::size_t base_;              // Stored messages older than the conversation, read on demand
+    std::size_t top_;               // Position of the message in the first row, kept up to date while following
+    std::size_t topRow_;            // Rows of that message above the screen
+    bool following_;                // Showing the newest messages
+    Fetch fetch_;
+    bool fetching_;                 // A backfill request is in flight
+    bool exhausted_;                // The server has nothing older than older_
+    std::list<Pending> pending_;    // In the order they were sent, shown after the conversation
+    std::unordered_map<std::string, std::list<Pending>::iterator> pendingIds_; // By clientId
+    std::vector<std::string> panel_;    // Covers the bottom rows while not empty
+};
+
+#endif /* chat_view_hpp */
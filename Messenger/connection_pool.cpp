@@ -0,0 +1,152 @@
+//
+//  connection_pool.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "connection_pool.hpp"
+#include <mutex>
+
+namespace {
+
+std::once_flag curlInitFlag;
+
+/**
+ * Applies the options every pooled handle needs before a request.
+ * Keep-alive probes stop idle connections from being dropped silently
+ * between ChatUpdater polls.
+ */
+void ApplyDefaults(CURL* curl){
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 30L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 15L);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+}
+
+}
+
+ConnectionPool::Handle::Handle(ConnectionPool* pool, CURL* curl) : pool_(pool), curl_(curl){}
+
+ConnectionPool::Handle::Handle(Handle&& other) noexcept : pool_(other.pool_), curl_(other.curl_){
+    other.curl_ = nullptr;
+}
+
+ConnectionPool::Handle& ConnectionPool::Handle::operator=(Handle&& other) noexcept{
+    if(this != &other){
+        Release();
+        pool_ = other.pool_;
+        curl_ = other.curl_;
+        other.curl_ = nullptr;
+    }
+    return *this;
+}
+
+ConnectionPool::Handle::~Handle(){
+    Release();
+}
+
+void ConnectionPool::Handle::Release(){
+    if(curl_){
+        pool_->Return(curl_);
+        curl_ = nullptr;
+    }
+}
+
+/**
+ * Creates an empty pool. Handles are only allocated when first needed.
+ *
+ * @param size Maximum number of handles (and therefore open connections).
+ */
+ConnectionPool::ConnectionPool(std::size_t size) : created_(0), capacity_(size > 0 ? size : 1){
+    std::call_once(curlInitFlag, [](){
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+    });
+}
+
+ConnectionPool::~ConnectionPool(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(CURL* curl : idle_){
+        curl_easy_cleanup(curl);
+    }
+    idle_.clear();
+}
+
+/**
+ * Checks out a handle, reusing an idle one when possible.
+ * Blocks while every handle is in use and the pool is at capacity.
+ *
+ * @return Handle ready for curl_easy_setopt; empty if curl_easy_init failed.
+ */
+ConnectionPool::Handle ConnectionPool::Acquire(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    available_.wait(lock, [this](){
+        return !idle_.empty() || created_ < capacity_;
+    });
+    return Take(lock);
+}
+
+/**
+ * Checks out a handle without waiting.
+ *
+ * @return Nothing if the pool is exhausted; otherwise a handle as returned by Acquire().
+ */
+std::optional<ConnectionPool::Handle> ConnectionPool::TryAcquire(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(idle_.empty() && created_ >= capacity_) return std::nullopt;
+    return Take(lock);
+}
+
+ConnectionPool::Handle ConnectionPool::Take(std::unique_lock<std::mutex>& lock){
+    CURL* curl = nullptr;
+    if(!idle_.empty()){
+        // Most recently returned handle first, its connection is the least likely to be stale
+        curl = idle_.back();
+        idle_.pop_back();
+    } else {
+        curl = curl_easy_init();
+        if(!curl) return Handle(this, nullptr);
+        created_++;
+    }
+    lock.unlock();
+
+    ApplyDefaults(curl);
+    return Handle(this, curl);
+}
+
+/**
+ * Changes the maximum number of handles.
+ * Shrinking frees idle handles right away and busy ones when they are returned.
+ *
+ * @param size New maximum, at least 1.
+ */
+void ConnectionPool::Resize(std::size_t size){
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = size > 0 ? size : 1;
+    while(created_ > capacity_ && !idle_.empty()){
+        curl_easy_cleanup(idle_.back());
+        idle_.pop_back();
+        created_--;
+    }
+    available_.notify_all();
+}
+
+std::size_t ConnectionPool::Size() const{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+}
+
+void ConnectionPool::Return(CURL* curl){
+    // Reset clears per-request options but keeps the live connection cache
+    curl_easy_reset(curl);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(created_ > capacity_){
+        curl_easy_cleanup(curl);
+        created_--;
+    } else {
+        idle_.push_back(curl);
+    }
+    available_.notify_one();
+}
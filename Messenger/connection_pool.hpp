@@ -0,0 +1,76 @@
+//
+//  connection_pool.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef connection_pool_hpp
+#define connection_pool_hpp
+
+#include <stdio.h>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <curl/curl.h>
+
+/**
+ * Pool of reusable libcurl easy handles.
+ *
+ * Reusing handles instead of calling curl_easy_init/curl_easy_cleanup per
+ * request keeps their allocations and caches warm; live connections are kept
+ * by the multi handle of HttpClient the handles are attached to.
+ * The pool size bounds how many requests can be in flight at once.
+ * Handles are created lazily up to the configured size; Acquire() blocks
+ * while all of them are checked out, TryAcquire() returns nothing instead.
+ */
+class ConnectionPool{
+public:
+    /**
+     * RAII wrapper around a checked out handle.
+     * Returns the handle to its pool when destroyed.
+     */
+    class Handle{
+    public:
+        Handle(ConnectionPool* pool, CURL* curl);
+        Handle(Handle&& other) noexcept;
+        Handle& operator=(Handle&& other) noexcept;
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        ~Handle();
+
+        CURL* get() const { return curl_; }
+        explicit operator bool() const { return curl_ != nullptr; }
+
+    private:
+        void Release();
+
+        ConnectionPool* pool_;
+        CURL* curl_;
+    };
+
+    explicit ConnectionPool(std::size_t size);
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    Handle Acquire();
+    std::optional<Handle> TryAcquire();
+    void Resize(std::size_t size);
+    std::size_t Size() const;
+
+private:
+    Handle Take(std::unique_lock<std::mutex>& lock);
+    void Return(CURL* curl);
+
+    mutable std::mutex mutex_;
+    std::condition_variable available_;
+    std::vector<CURL*> idle_;
+    std::size_t created_;
+    std::size_t capacity_;
+};
+
+#endif /* connection_pool_hpp */
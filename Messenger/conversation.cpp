@@ -0,0 +1,64 @@
+//
+//  conversation.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "conversation.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+bool ById(const ChatMessage& a, const ChatMessage& b){
+    return a.id < b.id;
+}
+
+}
+
+/**
+ * Appends the messages of a delta and advances the cursor.
+ *
+ * @param delta Result of Backend::GetChat called with Cursor().
+ * @return True if any message was added.
+ */
+bool Conversation::Append(ChatDelta&& delta){
+    // A failed request returns the cursor it was given, never an older one
+    if(delta.cursor < cursor_) return false;
+    cursor_ = delta.cursor;
+
+    // Inserted messages the cursor has passed are ordinary ones now, whether
+    // or not a delta repeated them
+    std::set<long long> early;
+    early.swap(ahead_);
+    ahead_.insert(early.upper_bound(cursor_), early.end());
+
+    // Add the delta without the messages it repeats, then merge it into place by id
+    std::size_t before = messages_.size();
+    for(ChatMessage& message : delta.messages){
+        if(early.count(message.id) == 0) messages_.push_back(std::move(message));
+    }
+    if(messages_.size() == before) return false;
+
+    auto from = std::upper_bound(messages_.begin(), messages_.begin() + before, messages_[before], ById);
+    std::inplace_merge(from, messages_.begin() + before, messages_.end(), ById);
+    return true;
+}
+
+/**
+ * Adds a message the server has stored but no delta has brought yet, e.g.
+ * the reply to a send. The cursor stays where it is, so the next poll still
+ * returns everything older that this client has not seen.
+ *
+ * @param message Stored message, with the id the server gave it.
+ * @return True if it was not shown yet.
+ */
+bool Conversation::Insert(ChatMessage message){
+    if(message.id <= cursor_ || ahead_.count(message.id)) return false;
+
+    ahead_.insert(message.id);
+    auto at = std::upper_bound(messages_.begin(), messages_.end(), message, ById);
+    messages_.insert(at, std::move(message));
+    return true;
+}
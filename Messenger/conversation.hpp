@@ -0,0 +1,38 @@
+//
+//  conversation.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef conversation_hpp
+#define conversation_hpp
+
+#include <stdio.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "backend.hpp"
+
+/**
+ * Client-side copy of one chat, grown by appending deltas from Backend::GetChat.
+ * Each poll only transfers messages past Cursor(), so its cost does not
+ * depend on how long the conversation already is. A message known ahead of
+ * the server's delta, like one just sent, can be inserted early; the delta
+ * that brings it later does not add it twice.
+ */
+class Conversation{
+public:
+    bool Append(ChatDelta&& delta);
+    bool Insert(ChatMessage message);
+
+    const std::vector<ChatMessage>& Messages() const { return messages_; }
+    long long Cursor() const { return cursor_; }
+
+private:
+    std::vector<ChatMessage> messages_;    // In id order
+    long long cursor_ = 0;
+    std::set<long long> ahead_;     // Ids inserted past the cursor that no delta has brought yet
+};
+
+#endif /* conversation_hpp */
@@ -0,0 +1,473 @@
+//
+//  http_client.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "http_client.hpp"
+#include <algorithm>
+#include <cctype>
+#include "request_stats.hpp"
+#include "trace.hpp"
+#include "probes.hpp"
+
+/**
+ * Callback function used by libcurl to write received data into a std::string.
+ * Appends the data chunk received to the string pointed by userp.
+ *
+ * @param contents Pointer to the received data buffer.
+ * @param size Size of each data element (usually 1).
+ * @param nmemb Number of elements.
+ * @param userp Pointer to std::string where data will be appended.
+ * @return Number of bytes processed.
+ */
+size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp){
+    ((std::string*)userp)->append((char*)contents, size * nmemb);
+    return size * nmemb;
+}
+
+/**
+ * libcurl header callback collecting response headers into HttpResponse::headers.
+ *
+ * @param userp Pointer to the HttpResponse being received.
+ */
+static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userp){
+    auto* response = (HttpResponse*)userp;
+    std::string line(buffer, size * nitems);
+
+    // A new status line (e.g. after a redirect or 100 Continue) starts a fresh header block
+    if(line.compare(0, 5, "HTTP/") == 0){
+        response->headers.clear();
+        return size * nitems;
+    }
+    std::size_t colon = line.find(':');
+    if(colon != std::string::npos){
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return std::tolower(c); });
+        std::size_t start = line.find_first_not_of(" \t", colon + 1);
+        std::size_t end = line.find_last_not_of(" \t\r\n");
+        response->headers[name] = start == std::string::npos || end < start ? "" : line.substr(start, end - start + 1);
+    }
+    return size * nitems;
+}
+
+/**
+ * Reads libcurl's timing breakdown and byte counts of a finished transfer.
+ */
+static RequestSample Measure(CURL* curl, const HttpResponse& response){
+    RequestSample sample;
+    sample.ok = response.result == CURLE_OK && response.status < 400;
+    curl_off_t value = 0;
+    if(curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &value) == CURLE_OK) sample.nameLookupUs = value;
+    if(curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &value) == CURLE_OK) sample.connectUs = value;
+    if(curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &value) == CURLE_OK) sample.firstByteUs = value;
+    if(curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &value) == CURLE_OK) sample.totalUs = value;
+    if(curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &value) == CURLE_OK) sample.sentBytes = value;
+    sample.receivedBytes = response.wireBytes;
+    sample.decodedBytes = response.decodedBytes;
+    return sample;
+}
+
+/**
+ * Returns the value of a response header, or an empty string.
+ *
+ * @param name Lower-case header name.
+ */
+std::string HttpResponse::Header(const std::string& name) const{
+    auto it = headers.find(name);
+    return it == headers.end() ? "" : it->second;
+}
+
+// Request ids, unique across clients
+static std::atomic<std::uint64_t> nextTransferId{1};
+
+/**
+ * State of one request while it is owned by the I/O thread.
+ */
+struct HttpClient::Transfer{
+    std::uint64_t id = 0;
+    HttpRequest request;
+    HttpResponse response;
+    Callback callback;
+    std::string url;
+    ConnectionPool::Handle handle{nullptr, nullptr};
+    struct curl_slist* headers = nullptr;
+    std::uint64_t submittedUs = 0;      // Trace::Now() at Submit and Start, 0 while tracing is off
+    std::uint64_t startedUs = 0;
+
+    ~Transfer(){
+        curl_slist_free_all(headers);
+    }
+};
+
+/**
+ * Process-wide client for the messenger server.
+ */
+HttpClient& HttpClient::Shared(){
+    static HttpClient client("http://127.0.0.1:4040", 4);
+    return client;
+}
+
+/**
+ * Creates the client and starts its I/O thread, or hooks it into reactor.
+ *
+ * @param baseUrl Scheme, host and port prepended to every request path.
+ * @param maxConnections Maximum number of requests in flight at once.
+ * @param reactor Loop to run on instead of an own thread; must outlive the client.
+ */
+HttpClient::HttpClient(const std::string& baseUrl, std::size_t maxConnections, Reactor* reactor)
+    : baseUrl_(baseUrl), pool_(maxConnections), multi_(curl_multi_init()), reactor_(reactor), timer_(0), stopping_(false){
+    if(reactor_){
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, TimerCallback);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+    } else {
+        thread_ = std::thread(&HttpClient::Run, this);
+    }
+}
+
+/**
+ * Stops the I/O thread. Requests still in flight complete with CURLE_ABORTED_BY_CALLBACK.
+ * With a reactor, must be called on its loop thread or once the loop has stopped.
+ */
+HttpClient::~HttpClient(){
+    stopping_ = true;
+    if(reactor_){
+        AbortAll();
+        if(timer_) reactor_->CancelTimer(timer_);
+    } else {
+        curl_multi_wakeup(multi_);
+        if(thread_.joinable()) thread_.join();
+    }
+    curl_multi_cleanup(multi_);
+}
+
+/**
+ * Queues a request for the I/O thread. Never blocks on the network.
+ *
+ * @param request Request to send.
+ * @param callback Invoked on the I/O thread once the request completes or fails.
+ * @return Id that can be passed to Cancel().
+ */
+std::uint64_t HttpClient::Submit(HttpRequest request, Callback callback){
+    auto transfer = std::make_unique<Transfer>();
+    transfer->id = nextTransferId++;
+    transfer->submittedUs = Trace::Enabled() ? Trace::Now() : 0;
+    transfer->request = std::move(request);
+    transfer->callback = std::move(callback);
+    std::uint64_t id = transfer->id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        submitted_.push_back(std::move(transfer));
+    }
+    Wake();
+    return id;
+}
+
+/**
+ * Queues a request and returns a future for its response.
+ *
+ * @param request Request to send.
+ * @return Future fulfilled on the I/O thread.
+ */
+std::future<HttpResponse> HttpClient::Submit(HttpRequest request){
+    auto promise = std::make_shared<std::promise<HttpResponse>>();
+    std::future<HttpResponse> future = promise->get_future();
+    Submit(std::move(request), [promise](HttpResponse&& response){
+        promise->set_value(std::move(response));
+    });
+    return future;
+}
+
+/**
+ * Aborts a request. Its callback runs with CURLE_ABORTED_BY_CALLBACK
+ * unless it already completed, in which case nothing happens.
+ *
+ * @param id Value returned by Submit().
+ */
+void HttpClient::Cancel(std::uint64_t id){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelled_.push_back(id);
+    }
+    Wake();
+}
+
+/**
+ * Changes how many requests may be in flight at once.
+ *
+ * @param size Maximum number of concurrent connections.
+ */
+void HttpClient::SetMaxConnections(std::size_t size){
+    pool_.Resize(size);
+    Wake();
+}
+
+/**
+ * I/O thread main loop: attaches new transfers, drives curl_multi and
+ * dispatches completions until the client is destroyed.
+ */
+void HttpClient::Run(){
+    Trace::NameThread("http io");
+    while(!stopping_){
+        Pump();
+
+        int running = 0;
+        curl_multi_perform(multi_, &running);
+        ReadMessages();
+
+        // Sleeps until socket activity, a libcurl timeout or curl_multi_wakeup
+        curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+    }
+    AbortAll();
+}
+
+/**
+ * Takes over submitted and cancelled requests and attaches as many waiting
+ * transfers as there are free handles, in submission order.
+ */
+void HttpClient::Pump(){
+    std::vector<std::unique_ptr<Transfer>> submitted;
+    std::vector<std::uint64_t> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        submitted.swap(submitted_);
+        cancelled.swap(cancelled_);
+    }
+    for(auto& transfer : submitted){
+        waiting_.push_back(std::move(transfer));
+    }
+    if(!cancelled.empty()) CancelPending(cancelled);
+
+    while(!waiting_.empty()){
+        std::optional<ConnectionPool::Handle> handle = pool_.TryAcquire();
+        if(!handle) break;
+        std::unique_ptr<Transfer> transfer = std::move(waiting_.front());
+        waiting_.pop_front();
+        transfer->handle = std::move(*handle);
+        Start(std::move(transfer));
+    }
+}
+
+/**
+ * Completes every transfer libcurl reports as done.
+ */
+void HttpClient::ReadMessages(){
+    int queued = 0;
+    while(CURLMsg* msg = curl_multi_info_read(multi_, &queued)){
+        if(msg->msg != CURLMSG_DONE) continue;
+        Transfer* transfer = nullptr;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&transfer);
+        Finish(transfer, msg->data.result);
+    }
+}
+
+/**
+ * Gets the loop to call Pump() soon. Safe to call from any thread.
+ */
+void HttpClient::Wake(){
+    if(reactor_){
+        reactor_->Post([this](){
+            if(stopping_) return;
+            Pump();
+            ReadMessages();
+        });
+    } else {
+        curl_multi_wakeup(multi_);
+    }
+}
+
+/**
+ * Fails everything still pending so no caller waits forever.
+ */
+void HttpClient::AbortAll(){
+    while(!active_.empty()){
+        Finish(active_.back().get(), CURLE_ABORTED_BY_CALLBACK);
+    }
+    std::vector<std::unique_ptr<Transfer>> rest;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rest.swap(submitted_);
+    }
+    for(auto& transfer : waiting_) rest.push_back(std::move(transfer));
+    waiting_.clear();
+    for(auto& transfer : rest){
+        transfer->response.result = CURLE_ABORTED_BY_CALLBACK;
+        transfer->callback(std::move(transfer->response));
+    }
+}
+
+/**
+ * libcurl socket callback in reactor mode: mirrors the sockets libcurl
+ * waits on into the reactor.
+ */
+int HttpClient::SocketCallback(CURL*, curl_socket_t socket, int what, void* userp, void*){
+    auto* client = (HttpClient*)userp;
+    if(what == CURL_POLL_REMOVE){
+        client->reactor_->Unwatch(socket);
+        return 0;
+    }
+    int events = (what & CURL_POLL_IN ? (int)Reactor::Readable : 0) | (what & CURL_POLL_OUT ? (int)Reactor::Writable : 0);
+    client->reactor_->Watch(socket, events, [client, socket](int ready){
+        int mask = (ready & Reactor::Readable ? CURL_CSELECT_IN : 0) | (ready & Reactor::Writable ? CURL_CSELECT_OUT : 0);
+        int running = 0;
+        curl_multi_socket_action(client->multi_, socket, mask, &running);
+        client->ReadMessages();
+        client->Pump();
+    });
+    return 0;
+}
+
+/**
+ * libcurl timer callback in reactor mode: keeps one reactor timer at
+ * libcurl's next timeout.
+ */
+int HttpClient::TimerCallback(CURLM*, long timeoutMs, void* userp){
+    auto* client = (HttpClient*)userp;
+    if(client->timer_){
+        client->reactor_->CancelTimer(client->timer_);
+        client->timer_ = 0;
+    }
+    if(timeoutMs < 0) return 0;
+
+    client->timer_ = client->reactor_->AddTimer(std::chrono::milliseconds(timeoutMs), [client](){
+        client->timer_ = 0;
+        int running = 0;
+        curl_multi_socket_action(client->multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+        client->ReadMessages();
+        client->Pump();
+    });
+    return 0;
+}
+
+/**
+ * Configures the transfer's handle and attaches it to the multi handle.
+ */
+void HttpClient::Start(std::unique_ptr<Transfer> transfer){
+    if(!transfer->handle){
+        // curl_easy_init failed
+        transfer->response.result = CURLE_FAILED_INIT;
+        transfer->callback(std::move(transfer->response));
+        return;
+    }
+    CURL* curl = transfer->handle.get();
+    if(transfer->submittedUs) transfer->startedUs = Trace::Now();
+
+    transfer->url = baseUrl_ + transfer->request.path;
+
+    // Set HTTP headers - content type JSON unless the caller overrides it
+    transfer->headers = curl_slist_append(transfer->headers, "Content-Type: application/json");
+    for(const std::string& header : transfer->request.headers){
+        transfer->headers = curl_slist_append(transfer->headers, header.c_str());
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, transfer->url.c_str());
+    // Empty string: offer every encoding libcurl was built with and decode transparently
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer->response);
+    if(transfer->request.onData){
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer.get());
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->response.body);
+    }
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, transfer->request.body.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, transfer->request.body.size());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, transfer->request.timeoutMs);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer.get());
+    MESSENGER_PROBE3(request_start, transfer->request.path.c_str(), transfer->id, transfer->request.body.size());
+
+    curl_multi_add_handle(multi_, curl);
+    active_.push_back(std::move(transfer));
+}
+
+/**
+ * Adds a finished transfer to the trace as the request's span with its
+ * phases inside: waiting for a handle, connecting, waiting for the first
+ * response byte and receiving the rest.
+ */
+void HttpClient::TraceTransfer(const Transfer& transfer, const RequestSample& sample){
+    std::uint64_t now = Trace::Now();
+    std::uint64_t started = transfer.startedUs ? transfer.startedUs : now;
+    Trace::Async("http", transfer.request.path, transfer.id, transfer.submittedUs, now);
+    Trace::Async("http", "queue", transfer.id, transfer.submittedUs, started);
+    if(!transfer.startedUs) return;
+    Trace::Async("http", "connect", transfer.id, started, started + sample.connectUs);
+    Trace::Async("http", "wait", transfer.id, started + sample.connectUs, started + sample.firstByteUs);
+    Trace::Async("http", "transfer", transfer.id, started + sample.firstByteUs, started + sample.totalUs);
+}
+
+/**
+ * Detaches a finished transfer, returns its handle to the pool and runs its callback.
+ */
+void HttpClient::Finish(Transfer* transfer, CURLcode result){
+    auto it = std::find_if(active_.begin(), active_.end(), [transfer](const std::unique_ptr<Transfer>& t){
+        return t.get() == transfer;
+    });
+    if(it == active_.end()) return;
+    std::unique_ptr<Transfer> done = std::move(*it);
+    active_.erase(it);
+
+    CURL* curl = done->handle.get();
+    curl_multi_remove_handle(multi_, curl);
+    done->response.result = result;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &done->response.status);
+    curl_off_t downloaded = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+    done->response.wireBytes = downloaded;
+    if(!done->request.onData){
+        done->response.decodedBytes = done->response.body.size();
+    }
+    RequestSample sample = Measure(curl, done->response);
+    // Cancelled requests, such as long-polls dropped on exit, tell nothing about the server
+    if(result != CURLE_ABORTED_BY_CALLBACK){
+        RequestStats::Shared().Record(done->request.path, sample);
+    }
+    if(done->submittedUs) TraceTransfer(*done, sample);
+    MESSENGER_PROBE6(request_end, done->request.path.c_str(), done->id, (int)result, done->response.status, sample.totalUs, sample.receivedBytes);
+
+    // Give the handle back before the callback so follow-up requests can use it
+    done->handle = ConnectionPool::Handle(nullptr, nullptr);
+    done->callback(std::move(done->response));
+}
+
+/**
+ * Aborts the given requests, whether attached to the multi handle or still waiting for a handle.
+ */
+void HttpClient::CancelPending(const std::vector<std::uint64_t>& ids){
+    for(std::uint64_t id : ids){
+        auto active = std::find_if(active_.begin(), active_.end(), [id](const std::unique_ptr<Transfer>& t){
+            return t->id == id;
+        });
+        if(active != active_.end()){
+            Finish(active->get(), CURLE_ABORTED_BY_CALLBACK);
+            continue;
+        }
+        auto waiting = std::find_if(waiting_.begin(), waiting_.end(), [id](const std::unique_ptr<Transfer>& t){
+            return t->id == id;
+        });
+        if(waiting != waiting_.end()){
+            std::unique_ptr<Transfer> transfer = std::move(*waiting);
+            waiting_.erase(waiting);
+            transfer->response.result = CURLE_ABORTED_BY_CALLBACK;
+            transfer->callback(std::move(transfer->response));
+        }
+    }
+}
+
+/**
+ * libcurl write callback for requests with HttpRequest::onData set.
+ *
+ * @param userp Pointer to the Transfer being received.
+ * @return Number of bytes processed; anything else makes libcurl abort.
+ */
+size_t HttpClient::StreamCallback(void* contents, size_t size, size_t nmemb, void* userp){
+    auto* transfer = (Transfer*)userp;
+    transfer->response.decodedBytes += size * nmemb;
+    return transfer->request.onData(transfer->response, (const char*)contents, size * nmemb) ? size * nmemb : 0;
+}
@@ -0,0 +1,122 @@
+//
+//  http_client.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef http_client_hpp
+#define http_client_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <curl/curl.h>
+#include "connection_pool.hpp"
+#include "reactor.hpp"
+
+struct RequestSample;
+
+/**
+ * A single POST to the messenger server.
+ */
+struct HttpRequest{
+    std::string path;                   // Endpoint path, e.g. "/login"
+    std::string body;                   // Request body
+    std::vector<std::string> headers;   // Extra "Name: value" headers
+    long timeoutMs = 0;                 // Whole-transfer timeout, 0 for none
+
+    // If set, receives the response body chunk by chunk on the I/O thread
+    // instead of HttpResponse::body, along with the response headers;
+    // returning false aborts the transfer
+    std::function<bool(const struct HttpResponse& head, const char* data, std::size_t size)> onData;
+};
+
+/**
+ * Result of an HttpRequest.
+ * result is CURLE_OK when the transfer itself succeeded, status is the HTTP code.
+ */
+struct HttpResponse{
+    CURLcode result = CURLE_OK;
+    long status = 0;
+    std::map<std::string, std::string> headers;     // Keyed by lower-case name
+    std::string body;
+    std::uint64_t wireBytes = 0;        // Body bytes received, before Content-Encoding is undone
+    std::uint64_t decodedBytes = 0;     // Body bytes after decompression
+
+    std::string Header(const std::string& name) const;
+};
+
+/**
+ * Asynchronous HTTP client driven by one long-lived I/O thread.
+ *
+ * All requests are submitted to a curl_multi event loop running on the I/O
+ * thread, so any number of requests can be in flight without spawning a
+ * thread per call. Completion callbacks run on the I/O thread and must not block.
+ *
+ * Given a Reactor instead, the client starts no thread: its sockets and
+ * timeouts are registered with the reactor through libcurl's socket
+ * callbacks and everything runs on the reactor's loop thread.
+ */
+class HttpClient{
+public:
+    using Callback = std::function<void(HttpResponse&& response)>;
+
+    static HttpClient& Shared();
+
+    HttpClient(const std::string& baseUrl, std::size_t maxConnections, Reactor* reactor = nullptr);
+    ~HttpClient();
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    std::uint64_t Submit(HttpRequest request, Callback callback);
+    std::future<HttpResponse> Submit(HttpRequest request);
+    void Cancel(std::uint64_t id);
+
+    void SetMaxConnections(std::size_t size);
+    const std::string& BaseUrl() const { return baseUrl_; }
+
+private:
+    struct Transfer;
+
+    void Run();
+    void Pump();
+    void ReadMessages();
+    void Wake();
+    void AbortAll();
+    void Start(std::unique_ptr<Transfer> transfer);
+    void Finish(Transfer* transfer, CURLcode result);
+    static void TraceTransfer(const Transfer& transfer, const RequestSample& sample);
+    void CancelPending(const std::vector<std::uint64_t>& ids);
+    static std::size_t StreamCallback(void* contents, std::size_t size, std::size_t nmemb, void* userp);
+    static int SocketCallback(CURL* easy, curl_socket_t socket, int what, void* userp, void* socketp);
+    static int TimerCallback(CURLM* multi, long timeoutMs, void* userp);
+
+    std::string baseUrl_;
+    ConnectionPool pool_;
+    CURLM* multi_;
+    Reactor* reactor_;                  // Drives multi_ instead of thread_ when set
+    std::uint64_t timer_;               // Reactor timer for libcurl's timeout, 0 if none
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Transfer>> submitted_;  // Guarded by mutex_
+    std::vector<std::uint64_t> cancelled_;              // Guarded by mutex_
+    std::deque<std::unique_ptr<Transfer>> waiting_;     // I/O thread only, waiting for a free handle
+    std::vector<std::unique_ptr<Transfer>> active_;     // I/O thread only, attached to multi_
+
+    std::atomic<bool> stopping_;
+    std::thread thread_;
+};
+
+#endif /* http_client_hpp */
@@ -0,0 +1,170 @@
+//
+//  latency_histogram.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "latency_histogram.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include "json-2.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+/**
+ * Raises target to value unless it already is at least as large.
+ */
+void RaiseTo(std::atomic<std::uint64_t>& target, std::uint64_t value){
+    std::uint64_t current = target.load(std::memory_order_relaxed);
+    while(value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)){}
+}
+
+/**
+ * Formats microseconds as milliseconds with one decimal.
+ */
+std::string Millis(std::uint64_t us){
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f", us / 1000.0);
+    return text;
+}
+
+}
+
+/**
+ * Adds one value. Safe to call from any thread.
+ */
+void LatencyHistogram::Record(std::uint64_t value){
+    counts_[Index(value)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    RaiseTo(max_, value);
+}
+
+/**
+ * Adds every value recorded in other, as if recorded here.
+ */
+void LatencyHistogram::Merge(const LatencyHistogram& other){
+    for(std::size_t i = 0; i < BUCKETS; i++){
+        std::uint64_t count = other.counts_[i].load(std::memory_order_relaxed);
+        if(count) counts_[i].fetch_add(count, std::memory_order_relaxed);
+    }
+    sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    RaiseTo(max_, other.Max());
+}
+
+/**
+ * Number of values recorded. Adds up the buckets, so Record() has one counter less to update.
+ */
+std::uint64_t LatencyHistogram::Count() const{
+    std::uint64_t count = 0;
+    for(const auto& bucket : counts_) count += bucket.load(std::memory_order_relaxed);
+    return count;
+}
+
+std::uint64_t LatencyHistogram::Max() const{
+    return max_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const{
+    std::uint64_t count = Count();
+    return count == 0 ? 0 : (double)sum_.load(std::memory_order_relaxed) / count;
+}
+
+/**
+ * Value at or below which the given percentage of the recorded values fall:
+ * the top of the bucket holding it, never above the largest value seen.
+ *
+ * @param percent Between 0 and 100, e.g. 99.9.
+ * @return The value, or 0 if nothing was recorded.
+ */
+std::uint64_t LatencyHistogram::Percentile(double percent) const{
+    std::uint64_t count = Count();
+    if(count == 0) return 0;
+    std::uint64_t rank = (std::uint64_t)std::ceil(count * percent / 100.0);
+    rank = std::clamp<std::uint64_t>(rank, 1, count);
+
+    std::uint64_t seen = 0;
+    for(std::size_t i = 0; i < BUCKETS; i++){
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if(seen >= rank) return std::min(Highest(i), Max());
+    }
+    return Max();
+}
+
+/**
+ * One-line summary of microsecond values, shown in milliseconds.
+ */
+std::string LatencyHistogram::Text() const{
+    return std::to_string(Count()) + " recorded, ms p50 " + Millis(Percentile(50)) + " p90 " + Millis(Percentile(90))
+         + " p99 " + Millis(Percentile(99)) + " p99.9 " + Millis(Percentile(99.9)) + " max " + Millis(Max());
+}
+
+/**
+ * Summary as a JSON object, in the unit the values were recorded in.
+ */
+std::string LatencyHistogram::Json() const{
+    return json{
+        {"count", Count()},
+        {"mean", Mean()},
+        {"p50", Percentile(50)},
+        {"p90", Percentile(90)},
+        {"p99", Percentile(99)},
+        {"p99.9", Percentile(99.9)},
+        {"max", Max()}
+    }.dump();
+}
+
+/**
+ * Bucket of a value: below 2^PRECISION_BITS the value itself, above it
+ * HALF sub-buckets for each further power of two.
+ */
+std::size_t LatencyHistogram::Index(std::uint64_t value){
+    const std::uint64_t limit = std::uint64_t(1) << RANGE_BITS;
+    if(value >= limit) value = limit - 1;
+    if(value < (std::uint64_t(1) << PRECISION_BITS)) return value;
+
+    int shift = std::bit_width(value) - PRECISION_BITS;
+    return (std::size_t(1) << PRECISION_BITS) + (shift - 1) * HALF + ((value >> shift) - HALF);
+}
+
+/**
+ * Largest value that falls in a bucket.
+ */
+std::uint64_t LatencyHistogram::Highest(std::size_t index){
+    if(index < (std::size_t(1) << PRECISION_BITS)) return index;
+
+    std::size_t offset = index - (std::size_t(1) << PRECISION_BITS);
+    int shift = offset / HALF + 1;
+    std::uint64_t top = offset % HALF + HALF;
+    return ((top + 1) << shift) - 1;
+}
+
+ChatLatency& ChatLatency::Shared(){
+    static ChatLatency latency;
+    return latency;
+}
+
+/**
+ * One line per histogram, for the /stats command.
+ */
+std::vector<std::string> ChatLatency::Report() const{
+    return {
+        "send: " + send.Text(),
+        "fetch: " + fetch.Text(),
+        "render: " + render.Text()
+    };
+}
+
+/**
+ * All histograms as a JSON object, values in microseconds.
+ */
+std::string ChatLatency::Json() const{
+    json all;
+    all["sendUs"] = json::parse(send.Json());
+    all["fetchUs"] = json::parse(fetch.Json());
+    all["renderUs"] = json::parse(render.Json());
+    return all.dump(2);
+}
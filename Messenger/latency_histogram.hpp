@@ -0,0 +1,93 @@
+//
+//  latency_histogram.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef latency_histogram_hpp
+#define latency_histogram_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Distribution of non-negative values, bucketed the way HdrHistogram does:
+ * values below 2^PRECISION_BITS are counted exactly, larger ones in
+ * power-of-two ranges split into 2^(PRECISION_BITS-1) linear sub-buckets,
+ * so every reported percentile is within 1/64 (1.6%) of the true value.
+ * Values up to 2^40 are told apart; larger ones share the top bucket.
+ *
+ * All counts live in a fixed array of atomics inside the object: Record()
+ * never allocates and never locks, a few relaxed atomic adds and a shift,
+ * so it can stay on in production and be called from any thread. Merge()
+ * folds another histogram in, e.g. per-thread or per-endpoint ones into a
+ * total. Readers get a snapshot that is exact once recording stopped.
+ */
+class LatencyHistogram{
+public:
+    void Record(std::uint64_t value);
+    void Merge(const LatencyHistogram& other);
+
+    std::uint64_t Count() const;
+    std::uint64_t Max() const;
+    double Mean() const;
+    std::uint64_t Percentile(double percent) const;
+
+    std::string Text() const;
+    std::string Json() const;
+
+private:
+    static const int PRECISION_BITS = 7;
+    static const int RANGE_BITS = 40;
+    static const std::size_t HALF = std::size_t(1) << (PRECISION_BITS - 1);
+    static const std::size_t BUCKETS = (std::size_t(1) << PRECISION_BITS) + (RANGE_BITS - PRECISION_BITS) * HALF;
+
+    static std::size_t Index(std::uint64_t value);
+    static std::uint64_t Highest(std::size_t index);
+
+    std::atomic<std::uint64_t> counts_[BUCKETS] = {};
+    std::atomic<std::uint64_t> sum_{0};
+    std::atomic<std::uint64_t> max_{0};
+};
+
+/**
+ * Records the microseconds from its creation to its destruction.
+ */
+class LatencyTimer{
+public:
+    explicit LatencyTimer(LatencyHistogram& histogram) : histogram_(histogram), start_(std::chrono::steady_clock::now()){}
+    ~LatencyTimer(){
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        histogram_.Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+    LatencyTimer(const LatencyTimer&) = delete;
+    LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * Process-wide latencies of the chat as the user sees it, in microseconds.
+ * Per-request network timings are kept by RequestStats.
+ */
+struct ChatLatency{
+    static ChatLatency& Shared();
+
+    LatencyHistogram send;      // Backend send call until the server's answer is parsed
+    LatencyHistogram fetch;     // /get-chat call until its messages are decoded: history sync and pages
+    LatencyHistogram render;    // Formatting and writing one screen update
+
+    std::vector<std::string> Report() const;
+    std::string Json() const;
+};
+
+#endif /* latency_histogram_hpp */
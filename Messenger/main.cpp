@@ -1,5 +1,5 @@
 // Compile command example:
-// g++ -std=c++17 -o messenger main.cpp backend.cpp -lcurl
+// g++ -std=c++20 -o messenger *.cpp -lcurl -lpthread
 
 #include <iostream>
 #include <thread>
@@ -9,6 +9,13 @@
 #include <chrono>
 #include <cctype>
 #include <mutex>  // Added to use std::mutex
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <unistd.h>
 
 #ifdef _WIN32
     #define CLEAR_COMMAND "cls"   // Windows clear console command
@@ -17,47 +24,226 @@
 #endif
 
 #include "backend.hpp"
+#include "conversation.hpp"
+#include "chat_store.hpp"
+#include "outbox.hpp"
+#include "task.hpp"
+#include "chat_socket.hpp"
+#include "http_client.hpp"
+#include "reactor.hpp"
+#include "screen_renderer.hpp"
+#include "chat_view.hpp"
+#include "poll_scheduler.hpp"
+#include "request_stats.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "probes.hpp"
 
 // Atomic boolean flag to control when chat threads should run/stop
 std::atomic<bool> running{true};
 
-// Mutex to synchronize output to console to avoid garbled prints
-std::mutex coutMutex;
+// Lets ChatUpdater sleep between retries yet wake up as soon as the chat is stopped
+std::mutex stopMutex;
+std::condition_variable stopCondition;
+
+// How long the server may hold a /wait-chat request open: the shortest hold while
+// the chat is active, the ceiling it grows to while idle
+const std::chrono::milliseconds LONG_POLL_MIN(25000);
+const std::chrono::milliseconds LONG_POLL_MAX(120000);
+
+// Ceiling of the delay between retries while the server is unreachable
+const std::chrono::milliseconds RETRY_MAX(30000);
+
+// Messages per history page fetched from the server
+const std::size_t CHAT_PAGE = 200;
+
+// Latest PollScheduler interval for /stats, written by whichever thread polls; 0 before the first poll and over a WebSocket
+std::atomic<long long> pollIntervalMs{0};
+std::atomic<bool> pollFailing{false};
 
 /**
- * Thread function that continuously fetches and displays chat messages
- * between 'username' and 'recipient' every 3 seconds.
+ * Publishes the scheduler's state after it changed, for StatsReport().
  */
-void ChatUpdater(const std::string& username, const std::string& recipient) {
-    while (running) {
-        system(CLEAR_COMMAND); // Clear the console for updated chat view
+void PublishSchedule(const PollScheduler& schedule) {
+    pollIntervalMs = schedule.Interval().count();
+    pollFailing = schedule.Failing();
+}
 
-        // Get chat history from backend
-        auto chat = Backend::GetChat(username, recipient);
+/**
+ * Sleeps for the given time, returning early once the chat is stopped.
+ */
+void WaitUnlessStopped(std::chrono::milliseconds duration) {
+    std::unique_lock<std::mutex> lock(stopMutex);
+    stopCondition.wait_for(lock, duration, [] { return !running; });
+}
 
-        // Display chat messages
-        for (const auto& [sendername, message] : chat) {
-            if (sendername == username) {
-                std::cout << "me> " << message << std::endl;
-            } else {
-                std::cout << sendername << "> " << message << std::endl;
-            }
+/**
+ * Handles the scrolling commands: /pgup and /pgdn, or the PageUp and
+ * PageDown keys, which a line-buffered terminal delivers as escape
+ * sequences once Enter is pressed.
+ *
+ * @return True if line was a scrolling command or another key sequence, not a message.
+ */
+bool Scroll(ChatView& view, const std::string& line) {
+    static const std::string pageUp = "\x1b[5~";
+    static const std::string pageDown = "\x1b[6~";
+
+    if (line == "/pgup") {
+        view.PageUp();
+        return true;
+    }
+    if (line == "/pgdn") {
+        view.PageDown();
+        return true;
+    }
+    if (line.empty() || line[0] != '\x1b') {
+        return false;
+    }
+    // Each key pressed before Enter scrolls once; other keys are ignored
+    std::size_t i = 0;
+    while (i < line.size()) {
+        if (line.compare(i, pageUp.size(), pageUp) == 0) {
+            view.PageUp();
+            i += pageUp.size();
+        } else if (line.compare(i, pageDown.size(), pageDown) == 0) {
+            view.PageDown();
+            i += pageDown.size();
+        } else {
+            break;
         }
-        std::this_thread::sleep_for(std::chrono::seconds(3)); // Wait before refreshing chat
     }
+    return true;
 }
 
 /**
- * Thread function to handle user input.
- * Reads messages from user and sends them via Backend.
- * If user types "/exit", it stops the chat.
+ * Saves the request statistics of this run next to the user's chats, so
+ * slow requests can be told apart after the fact: connect setup, server
+ * time or transfer.
+ */
+void SaveStats(const std::string& username) {
+    std::string dir = ChatStore::UserDirectory(username);
+    if (!dir.empty()) {
+        RequestStats::Shared().Dump(dir + "/stats.json");
+    }
+}
+
+/**
+ * Lines shown by the /stats command: chat latencies, the parsing pool, then each endpoint.
  */
-void InputHandler(const std::string& username, const std::string& recipient) {
+std::vector<std::string> StatsReport() {
+    std::vector<std::string> lines = ChatLatency::Shared().Report();
+
+    // Stolen tasks ran on another worker than the one they were queued on
+    ThreadPoolStats pool = ThreadPool::Shared().Stats();
+    char text[160];
+    snprintf(text, sizeof(text), "pool: %zu threads, %llu tasks, %llu stolen, ms wait avg/max %.2f/%.2f, run avg %.2f",
+             pool.threads, (unsigned long long)pool.executed, (unsigned long long)pool.stolen,
+             pool.averageWaitUs / 1000.0, pool.maxWaitUs / 1000.0, pool.averageRunUs / 1000.0);
+    lines.push_back(text);
+
+    // How often an idle chat polls now, or how long until the next retry
+    long long interval = pollIntervalMs;
+    if (interval > 0) {
+        snprintf(text, sizeof(text), pollFailing ? "long-poll: server unreachable, retrying every %.1f s" : "long-poll: held up to %.1f s",
+                 interval / 1000.0);
+        lines.push_back(text);
+    }
+
+    std::vector<std::string> requests = RequestStats::Shared().Report();
+    lines.insert(lines.end(), requests.begin(), requests.end());
+    return lines;
+}
+
+/**
+ * Thread function that keeps the chat between 'username' and 'recipient' on screen.
+ * The history saved by earlier runs is already on screen from the local ChatStore,
+ * so only messages sent since then are fetched, and it stays readable offline.
+ * Over HTTP it long-polls the server, so new messages show up one round-trip
+ * after they are sent, and the PollScheduler stretches the polls of an idle
+ * chat up to one request per LONG_POLL_MAX.
+ * Over a WebSocket the server pushes them as they are stored.
+ */
+void ChatUpdater(const std::string& username, const std::string& recipient, ChatSocket* socket, ChatView* view) {
+    Trace::NameThread("updater");
+    bool synced = false;
+    PollScheduler schedule(LONG_POLL_MIN, LONG_POLL_MAX, RETRY_MAX);
+    pollIntervalMs = 0;
+
+    if (socket) {
+        // Nothing stored yet: only the newest page, older ones are fetched when scrolled to
+        socket->Subscribe(recipient, view->Cursor(), CHAT_PAGE);
+    }
+
     while (running) {
+        // Everything past the stored history on the first pass, then block until something new arrives
+        ChatDelta delta;
+        bool held = false;
+        if (socket) {
+            delta = socket->NextChat();
+        } else if (!synced && view->Cursor() == 0) {
+            // Nothing stored yet: only the newest page, older ones are fetched when scrolled to
+            delta = Backend::GetChatPage(username, recipient, CHAT_PAGE);
+        } else if (!synced) {
+            delta = Backend::GetChat(username, recipient, view->Cursor());
+        } else {
+            delta = Backend::WaitChatAsync(username, recipient, view->Cursor(), schedule.Hold().count()).get();
+            held = true;
+        }
+        if (!running) break;
+        synced = true;
+
+        // Redraws only when something arrived, so an idle chat keeps the prompt intact
+        bool failed = !delta.ok;
+        bool empty = delta.messages.empty();
+        MESSENGER_PROBE2(refresh, delta.messages.size(), !failed);
         {
-            std::lock_guard<std::mutex> lock(coutMutex); // Lock cout for clean prompt display
-            std::cout << "me> ";
+            TraceSpan span("chat", "refresh");
+            view->Append(std::move(delta));
+        }
+
+        if (failed && socket && !socket->IsOpen()) {
+            socket = nullptr; // Connection lost, continue over HTTP
+        } else if (failed) {
+            schedule.Failure();
+            if (!socket) PublishSchedule(schedule);
+            WaitUnlessStopped(schedule.Delay()); // Server unreachable, don't spin
+        } else if (!empty) {
+            schedule.Activity();
+        } else if (held) {
+            schedule.Idle();
         }
+        if (!socket && !failed) PublishSchedule(schedule);
+    }
+}
+
+/**
+ * Stops a running chat: wakes the updater out of its long-poll, push or back-off wait.
+ */
+void StopChat(ChatSocket* socket) {
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        running = false;
+    }
+    Backend::CancelWaits();
+    if (socket) {
+        socket->Close();
+    }
+    stopCondition.notify_all();
+}
+
+/**
+ * Thread function to handle user input.
+ * Reads messages from user and queues them in the outbox, which delivers
+ * them in the background, so the prompt never waits for the server.
+ * If user types "/exit", it stops the chat; "/stats" shows how long
+ * requests took until the next line is entered.
+ */
+void InputHandler(const std::string& recipient, Outbox* outbox, ScreenRenderer* screen, ChatView* view) {
+    Trace::NameThread("input");
+    std::string prompt = "me> ";
+    while (running) {
+        screen->Prompt(prompt);
+        prompt = "me> ";
         std::string newMessage;
         std::getline(std::cin, newMessage);
 
@@ -65,19 +251,297 @@ void InputHandler(const std::string& username, const std::string& recipient) {
             running = false; // Signal to stop chat
             break;
         }
+        if (newMessage == "/stats") {
+            view->ShowPanel(StatsReport());
+            continue;
+        }
+        view->ClosePanel();
+        if (Scroll(*view, newMessage)) {
+            continue;
+        }
 
         if (!newMessage.empty()) {
-            bool send = Backend::SendMessage(username, recipient, newMessage);
-            if (!send) {
-                std::cout << "Failed to send message" << std::endl;
+            if (!outbox->Enqueue(recipient, newMessage)) {
+                prompt = "Message not saved, it is lost if the app closes before it is sent. me> ";
+            }
+        }
+    }
+}
+
+/**
+ * Opens the WebSocket transport if MESSENGER_TRANSPORT=ws is set.
+ *
+ * @return Connected socket, or nullptr to use plain HTTP requests.
+ */
+std::unique_ptr<ChatSocket> ConnectTransport(const std::string& username) {
+    const char* transport = std::getenv("MESSENGER_TRANSPORT");
+    if (!transport || std::string(transport) != "ws") {
+        return nullptr;
+    }
+    auto socket = std::make_unique<ChatSocket>();
+    if (!socket->Connect(username)) {
+        std::cout << "WebSocket unavailable, using HTTP" << std::endl;
+        return nullptr;
+    }
+    return socket;
+}
+
+/**
+ * Logs in (or registers) and fetches the list of users to chat with in the
+ * same round-trip: both requests are in flight before either is awaited.
+ *
+ * @return The other users, or nothing if the credentials were rejected.
+ */
+Task<std::optional<std::map<int,std::string>>> SignIn(std::string username, std::string password, bool registering) {
+    // Dropped unanswered if authentication fails
+    Awaitable<std::map<int,std::string>> users = Backend::GetUsersCo(username);
+
+    bool success = registering
+        ? co_await Backend::RegisterCo(username, password)
+        : co_await Backend::LoginCo(username, password);
+    if (!success) {
+        co_return std::nullopt;
+    }
+    co_return co_await users;
+}
+
+/**
+ * Single-threaded variant of OpenChat, chosen with MESSENGER_UI=reactor.
+ * Keyboard input, the HTTP sockets and the retry timer are all served by
+ * one Reactor, so output needs no locking, /exit takes effect at once
+ * and an idle chat sleeps in the kernel until the long-poll answers.
+ * Only the outbox still delivers from its own thread.
+ */
+void RunChatReactor(const std::string& username, const std::string& recipient) {
+    Reactor reactor;
+    auto client = std::make_shared<HttpClient>(HttpClient::Shared().BaseUrl(), 4, &reactor);
+    Backend::UseClient(client);
+
+    ScreenRenderer screen;
+    screen.Prompt("me> ");
+    ChatStore store(username, recipient);
+    ChatView view(username, store, screen);
+    view.LoadHistory();
+
+    Backend::ResumeWaits(); // Cancelled when the previous chat closed
+    bool stopped = false;
+    int inflight = 0;       // Long-polls whose result has not reached the loop yet
+    std::uint64_t retry = 0;
+    PollScheduler schedule(LONG_POLL_MIN, LONG_POLL_MAX, RETRY_MAX);
+    pollIntervalMs = 0;
+    std::string input;      // Keyboard bytes not yet ending in a newline
+
+    {
+        Outbox outbox(username);
+        outbox.Start([username](const OutboxEntry& entry) {
+            return Backend::SendMessageAsync(username, entry.friendname, entry.message, entry.clientId);
+        }, [&view, recipient](const OutboxEntry& entry) {
+            // Shown at once, reconciled with the server's answer below
+            if (entry.friendname == recipient) view.AddPending(entry.clientId, entry.message);
+        }, [&reactor, &view, recipient](const OutboxEntry& entry, const SendReceipt& receipt) {
+            if (entry.friendname != recipient) return;
+            reactor.Post([&view, clientId = entry.clientId, receipt]() { view.Settle(clientId, receipt); });
+        });
+
+        auto stop = [&]() {
+            stopped = true;
+            if (retry) reactor.CancelTimer(retry);
+            Backend::CancelWaits();
+        };
+
+        view.SetBackfill([&](long long before) {
+            inflight++;
+            Backend::GetChatPageAsync(username, recipient, CHAT_PAGE, before, [&](ChatDelta page) {
+                reactor.Post([&, page = std::move(page)]() mutable {
+                    inflight--;
+                    view.Backfill(std::move(page));
+                });
+            });
+        });
+
+        // The server answers at once while there is anything past the cursor, so the first poll also syncs the history
+        std::function<void()> poll = [&]() {
+            inflight++;
+            Backend::WaitChatAsync(username, recipient, view.Cursor(), schedule.Hold().count(), [&](ChatDelta delta) {
+                // Results arrive on a pool worker; all chat state belongs to the loop thread
+                reactor.Post([&, delta = std::move(delta)]() mutable {
+                    inflight--;
+                    if (stopped) return;
+
+                    bool failed = !delta.ok;
+                    bool empty = delta.messages.empty();
+                    MESSENGER_PROBE2(refresh, delta.messages.size(), !failed);
+                    {
+                        TraceSpan span("chat", "refresh");
+                        view.Append(std::move(delta));
+                    }
+                    if (failed) {
+                        // Server unreachable, don't spin
+                        schedule.Failure();
+                        PublishSchedule(schedule);
+                        retry = reactor.AddTimer(schedule.Delay(), [&]() {
+                            retry = 0;
+                            poll();
+                        });
+                        return;
+                    }
+                    if (empty) {
+                        schedule.Idle();
+                    } else {
+                        schedule.Activity();
+                    }
+                    PublishSchedule(schedule);
+                    poll();
+                });
+            });
+        };
+
+        reactor.Watch(STDIN_FILENO, Reactor::Readable, [&](int) {
+            char buffer[4096];
+            ssize_t size = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (size <= 0) {
+                stop(); // End of input
+                return;
             }
+            input.append(buffer, size);
+
+            std::size_t end;
+            while (!stopped && (end = input.find('\n')) != std::string::npos) {
+                std::string line = input.substr(0, end);
+                input.erase(0, end + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+
+                if (line != "/stats") view.ClosePanel();
+                if (line == "/exit") {
+                    stop();
+                } else if (line == "/stats") {
+                    view.ShowPanel(StatsReport());
+                    screen.Prompt("me> ");
+                } else if (Scroll(view, line)) {
+                    screen.Prompt("me> ");
+                } else if (!line.empty() && !outbox.Enqueue(recipient, line)) {
+                    screen.Prompt("Message not saved, it is lost if the app closes before it is sent. me> ");
+                } else {
+                    screen.Prompt("me> ");
+                }
+            }
+        });
+
+        int resize = ScreenRenderer::ResizeEvents();
+        if (resize >= 0) {
+            reactor.Watch(resize, Reactor::Readable, [&](int) {
+                ScreenRenderer::TakeResizeEvents();
+                view.Redraw();
+            });
+        }
+
+        if (view.Cursor() == 0) {
+            // Nothing stored yet: only the newest page, older ones are fetched when scrolled to
+            inflight++;
+            Backend::GetChatPageAsync(username, recipient, CHAT_PAGE, 0, [&](ChatDelta page) {
+                reactor.Post([&, page = std::move(page)]() mutable {
+                    inflight--;
+                    if (stopped) return;
+                    view.Append(std::move(page));
+                    poll();
+                });
+            });
+        } else {
+            poll();
+        }
+        reactor.RunUntil([&]() { return stopped && inflight == 0; });
+        reactor.Unwatch(STDIN_FILENO);
+        if (resize >= 0) reactor.Unwatch(resize);
+    }
+    Backend::UseClient(nullptr);
+}
+
+/**
+ * Runs a chat with 'recipient' until the user types /exit.
+ */
+void OpenChat(const std::string& username, const std::string& recipient, ChatSocket* socket) {
+    const char* ui = std::getenv("MESSENGER_UI");
+    if (!socket && ui && std::string(ui) == "reactor") {
+        RunChatReactor(username, recipient);
+        SaveStats(username);
+        return;
+    }
+    running = true;
+    Backend::ResumeWaits(); // Cancelled when the previous chat closed
+
+    // Stored history goes on screen before the network is touched
+    ScreenRenderer screen;
+    ChatStore store(username, recipient);
+    ChatView view(username, store, screen);
+    view.LoadHistory();
+
+    // Also delivers messages left over from earlier runs; declared after the view it reports to
+    Outbox outbox(username);
+    outbox.Start([username, socket](const OutboxEntry& entry) {
+        if (socket && socket->IsOpen()) {
+            return socket->SendMessageAsync(entry.friendname, entry.message, entry.clientId);
         }
+        return Backend::SendMessageAsync(username, entry.friendname, entry.message, entry.clientId);
+    }, [&view, recipient](const OutboxEntry& entry) {
+        // Shown at once, reconciled with the server's answer below
+        if (entry.friendname == recipient) view.AddPending(entry.clientId, entry.message);
+    }, [&view, recipient](const OutboxEntry& entry, const SendReceipt& receipt) {
+        if (entry.friendname == recipient) view.Settle(entry.clientId, receipt);
+    });
+
+    // Older history is fetched in the background; the count lets the chat close only once it is back
+    int backfills = 0;
+    view.SetBackfill([&](long long before) {
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            backfills++;
+        }
+        Backend::GetChatPageAsync(username, recipient, CHAT_PAGE, before, [&](ChatDelta page) {
+            view.Backfill(std::move(page));
+            {
+                std::lock_guard<std::mutex> lock(stopMutex);
+                backfills--;
+            }
+            stopCondition.notify_all();
+        });
+    });
+
+    // Redraws on terminal resizes while the other threads block on input and the network
+    Reactor events;
+    bool closed = false;
+    int resize = ScreenRenderer::ResizeEvents();
+    if (resize >= 0) {
+        events.Watch(resize, Reactor::Readable, [&](int) {
+            ScreenRenderer::TakeResizeEvents();
+            view.Redraw();
+        });
     }
+    std::thread resizer([&]() { events.RunUntil([&]() { return closed; }); });
+
+    // Start chat updater and input handler threads
+    std::thread updater(ChatUpdater, username, recipient, socket, &view);
+    std::thread input(InputHandler, recipient, &outbox, &screen, &view);
+
+    input.join();  // Wait for input thread to finish (user typed /exit)
+    StopChat(socket);
+    updater.join(); // Then wait for updater thread to stop
+    events.Post([&]() { closed = true; });
+    resizer.join();
+
+    std::unique_lock<std::mutex> lock(stopMutex);
+    stopCondition.wait(lock, [&]() { return backfills == 0; });
+    SaveStats(username);
 }
 
 int main() {
     bool app = true; // Main app loop flag
 
+    // Opt-in timeline for Perfetto, written on exit and on SIGUSR1
+    if (const char* trace = std::getenv("MESSENGER_TRACE")) {
+        Trace::Start(trace);
+        Trace::NameThread("main");
+    }
+
     while (app) {
         std::cout << "Login: l - Register: r -- ";
         char auth;
@@ -94,11 +558,11 @@ int main() {
             std::string password;
             std::getline(std::cin, password);
 
-            // Try logging in via backend
-            bool login = Backend::Login(username, password);
-            if(login) {
-                // Get list of other users to chat with
-                std::map<int,std::string> array = Backend::GetUsers(username);
+            // Try logging in via backend, fetching the list of other users to chat with alongside
+            std::optional<std::map<int,std::string>> users = SyncWait(SignIn(username, password, false));
+            if(users) {
+                std::unique_ptr<ChatSocket> socket = ConnectTransport(username);
+                std::map<int,std::string> array = std::move(*users);
 
                 system(CLEAR_COMMAND);
                 std::cout << "Settings: s" << std::endl;
@@ -117,15 +581,7 @@ int main() {
                     int index = home - '0';
                     if (array.find(index) != array.end()) {
                         std::string recipient = array[index];
-
-                        running = true;
-                        // Start chat updater and input handler threads
-                        std::thread updater(ChatUpdater, username, recipient);
-                        std::thread input(InputHandler, username, recipient);
-
-                        input.join();  // Wait for input thread to finish (user typed /exit)
-                        running = false;
-                        updater.join(); // Then wait for updater thread to stop
+                        OpenChat(username, recipient, socket.get());
                     }
                 } else if(home == 's'){
                     // Settings option, currently just exits
@@ -146,9 +602,10 @@ int main() {
             std::getline(std::cin, password);
 
             // Register new user via backend
-            bool reg = Backend::Register(username, password);
-            if(reg){
-                std::map<int,std::string> array = Backend::GetUsers(username);
+            std::optional<std::map<int,std::string>> users = SyncWait(SignIn(username, password, true));
+            if(users){
+                std::unique_ptr<ChatSocket> socket = ConnectTransport(username);
+                std::map<int,std::string> array = std::move(*users);
 
                 system(CLEAR_COMMAND);
                 std::cout << "Settings: s" << std::endl;
@@ -167,15 +624,7 @@ int main() {
                     int index = home - '0';
                     if (array.find(index) != array.end()) {
                         std::string recipient = array[index];
-
-                        running = true;
-                        // Start chat updater and input handler threads
-                        std::thread updater(ChatUpdater, username, recipient);
-                        std::thread input(InputHandler, username, recipient);
-
-                        input.join();  // Wait for input thread to finish (user typed /exit)
-                        running = false;
-                        updater.join(); // Then wait for updater thread to stop
+                        OpenChat(username, recipient, socket.get());
                     }
                 } else if(home == 's'){
                     // Settings option, currently just exits
@@ -191,5 +640,6 @@ int main() {
             app = false;
         }
     }
+    Trace::Flush();
     return 0;
 }
@@ -0,0 +1,265 @@
+//
+//  outbox.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "outbox.hpp"
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "json-2.hpp"
+#include "chat_store.hpp"
+#include "trace.hpp"
+#include "probes.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Retry delays while the server is unreachable
+const std::chrono::milliseconds MIN_BACKOFF(500);
+const std::chrono::milliseconds MAX_BACKOFF(30000);
+
+// How often a send in progress checks whether the outbox is shutting down
+const std::chrono::milliseconds STOP_CHECK(100);
+
+bool WriteAll(int fd, const std::string& data){
+    const char* next = data.data();
+    std::size_t left = data.size();
+    while(left > 0){
+        ssize_t written = write(fd, next, left);
+        if(written <= 0) return false;
+        next += written;
+        left -= written;
+    }
+    return true;
+}
+
+}
+
+/**
+ * Opens the user's outbox log and loads the messages a previous run did not deliver.
+ * Nothing is sent until Start() is called.
+ *
+ * @param username Sender of every message in this outbox.
+ */
+Outbox::Outbox(const std::string& username) : fd_(-1), random_(std::random_device{}()), stopping_(false){
+    std::string dir = ChatStore::UserDirectory(username);
+    if(dir.empty()) return;
+    path_ = dir + "/outbox.log";
+    if(!Replay()){
+        std::cout << "Outbox unavailable, messages will not be kept" << std::endl;
+    }
+}
+
+/**
+ * Stops the sender thread. Undelivered messages stay in the log for the next run.
+ */
+Outbox::~Outbox(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if(thread_.joinable()) thread_.join();
+    if(fd_ >= 0) close(fd_);
+}
+
+/**
+ * Starts delivering queued messages in the background.
+ *
+ * @param sender Sends one entry and resolves once the server answered.
+ * @param queued Optional, called for each entry left from earlier runs before
+ *               this returns, then from Enqueue() before the entry can be sent.
+ * @param answered Optional, called on the sender thread after each attempt;
+ *                 a receipt that is not ok means the entry will be sent again.
+ */
+void Outbox::Start(Sender sender, Queued queued, Answered answered){
+    if(thread_.joinable()) return;
+    sender_ = std::move(sender);
+    queued_ = std::move(queued);
+    answered_ = std::move(answered);
+    if(queued_){
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(const OutboxEntry& entry : queue_) queued_(entry);
+    }
+    thread_ = std::thread(&Outbox::Run, this);
+}
+
+/**
+ * Queues a message. Returns as soon as it is safely on disk.
+ *
+ * @param friendname Recipient's username.
+ * @param message Text message to send.
+ * @return False if the message could not be written to the log; it is still sent if possible.
+ */
+bool Outbox::Enqueue(const std::string& friendname, const std::string& message){
+    bool stored;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        OutboxEntry entry{NextClientId(), friendname, message};
+
+        json record;
+        record["op"] = "add";
+        record["clientId"] = entry.clientId;
+        record["friendname"] = entry.friendname;
+        record["message"] = entry.message;
+        stored = WriteRecord(record.dump(), true);
+
+        if(queued_) queued_(entry);
+        queue_.push_back(std::move(entry));
+    }
+    wake_.notify_all();
+    return stored;
+}
+
+/**
+ * Number of messages not confirmed by the server yet.
+ */
+std::size_t Outbox::Pending(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+/**
+ * Sender thread: delivers the oldest entry, then the next, backing off while sends fail.
+ */
+void Outbox::Run(){
+    Trace::NameThread("outbox");
+    std::chrono::milliseconds backoff = MIN_BACKOFF;
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while(true){
+        wake_.wait(lock, [this]{ return stopping_ || !queue_.empty(); });
+        if(stopping_) return;
+        OutboxEntry entry = queue_.front();
+        lock.unlock();
+
+        SendReceipt receipt;
+        MESSENGER_PROBE2(message_send, entry.clientId.c_str(), entry.message.size());
+        unsigned long long sendStart = MESSENGER_PROBE_NOW(message_ack);
+        try {
+            std::future<SendReceipt> result = sender_(entry);
+            // Stop waiting on shutdown; the entry stays in the log and the clientId covers a late success
+            while(result.wait_for(STOP_CHECK) != std::future_status::ready){
+                lock.lock();
+                bool stopping = stopping_;
+                lock.unlock();
+                if(stopping) return;
+            }
+            receipt = result.get();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+        }
+        MESSENGER_PROBE3(message_ack, entry.clientId.c_str(), receipt.ok, MESSENGER_PROBE_NOW(message_ack) - sendStart);
+        if(answered_) answered_(entry, receipt);
+
+        lock.lock();
+        if(!receipt.ok){
+            wake_.wait_for(lock, backoff, [this]{ return stopping_; });
+            backoff = std::min(backoff * 2, MAX_BACKOFF);
+            continue;
+        }
+        backoff = MIN_BACKOFF;
+        queue_.pop_front();
+
+        if(queue_.empty()){
+            // Everything delivered: start the log over instead of letting it grow
+            if(fd_ >= 0 && ftruncate(fd_, 0) != 0){
+                WriteRecord(json{{"op", "done"}, {"clientId", entry.clientId}}.dump(), false);
+            }
+        } else {
+            WriteRecord(json{{"op", "done"}, {"clientId", entry.clientId}}.dump(), false);
+        }
+    }
+}
+
+/**
+ * Loads undelivered entries from the log and rewrites it with only those.
+ * A last line torn by a crash is dropped; its message never reached the UI
+ * as saved.
+ *
+ * @return False if the log cannot be used.
+ */
+bool Outbox::Replay(){
+    std::string contents;
+    int in = open(path_.c_str(), O_RDONLY);
+    if(in >= 0){
+        char chunk[65536];
+        ssize_t received;
+        while((received = read(in, chunk, sizeof(chunk))) > 0){
+            contents.append(chunk, received);
+        }
+        close(in);
+    }
+
+    std::size_t start = 0;
+    std::size_t end;
+    while((end = contents.find('\n', start)) != std::string::npos){
+        try {
+            json record = json::parse(contents.begin() + start, contents.begin() + end);
+            std::string clientId = record["clientId"];
+            if(record["op"] == "add"){
+                queue_.push_back({clientId, record["friendname"], record["message"]});
+            } else if(record["op"] == "done"){
+                auto it = std::find_if(queue_.begin(), queue_.end(), [&clientId](const OutboxEntry& entry){
+                    return entry.clientId == clientId;
+                });
+                if(it != queue_.end()) queue_.erase(it);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+        }
+        start = end + 1;
+    }
+
+    // Compact into a new file first so a crash here cannot lose pending entries
+    std::string compacted;
+    for(const OutboxEntry& entry : queue_){
+        json record;
+        record["op"] = "add";
+        record["clientId"] = entry.clientId;
+        record["friendname"] = entry.friendname;
+        record["message"] = entry.message;
+        compacted += record.dump() + "\n";
+    }
+    std::string temporary = path_ + ".tmp";
+    int out = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(out < 0) return false;
+    bool written = WriteAll(out, compacted) && fsync(out) == 0;
+    close(out);
+    if(!written || rename(temporary.c_str(), path_.c_str()) != 0) return false;
+
+    fd_ = open(path_.c_str(), O_WRONLY | O_APPEND);
+    return fd_ >= 0;
+}
+
+/**
+ * Appends one line to the log. Caller holds mutex_.
+ *
+ * @param sync Wait until the line is on disk.
+ */
+bool Outbox::WriteRecord(const std::string& record, bool sync){
+    if(fd_ < 0) return false;
+    if(!WriteAll(fd_, record + "\n")) return false;
+    return !sync || fsync(fd_) == 0;
+}
+
+/**
+ * Random 128-bit id in hex. Caller holds mutex_.
+ */
+std::string Outbox::NextClientId(){
+    static const char hex[] = "0123456789abcdef";
+    std::string id;
+    for(int part = 0; part < 2; part++){
+        std::uint64_t bits = random_();
+        for(int i = 0; i < 16; i++){
+            id += hex[bits & 15];
+            bits >>= 4;
+        }
+    }
+    return id;
+}
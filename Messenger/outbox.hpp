@@ -0,0 +1,81 @@
+//
+//  outbox.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef outbox_hpp
+#define outbox_hpp
+
+#include <stdio.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include "backend.hpp"
+
+/**
+ * A message waiting in the outbox.
+ */
+struct OutboxEntry{
+    std::string clientId;       // Unique per message, lets the server drop resends
+    std::string friendname;
+    std::string message;
+};
+
+/**
+ * Durable queue of outgoing messages for one user.
+ *
+ * Enqueue() only appends the message to a write-ahead log on disk and
+ * returns, so typing never waits for the network. A background thread sends
+ * the entries in order, retrying with back-off while the server is
+ * unreachable, and marks each one done in the log once the server confirms
+ * it. Entries still pending when the program exits or crashes are sent on
+ * the next run; the clientId keeps the server from storing a message twice.
+ * Every entry is reported once queued and again after each send attempt
+ * with the server's receipt, so the chat can show it as pending right away
+ * and swap in the stored message without waiting for the chat to be fetched.
+ */
+class Outbox{
+public:
+    using Sender = std::function<std::future<SendReceipt>(const OutboxEntry& entry)>;
+    using Queued = std::function<void(const OutboxEntry& entry)>;
+    using Answered = std::function<void(const OutboxEntry& entry, const SendReceipt& receipt)>;
+
+    explicit Outbox(const std::string& username);
+    ~Outbox();
+
+    Outbox(const Outbox&) = delete;
+    Outbox& operator=(const Outbox&) = delete;
+
+    void Start(Sender sender, Queued queued = nullptr, Answered answered = nullptr);
+    bool Enqueue(const std::string& friendname, const std::string& message);
+    std::size_t Pending();
+
+private:
+    void Run();
+    bool Replay();
+    bool WriteRecord(const std::string& record, bool sync);
+    std::string NextClientId();
+
+    std::string path_;
+    int fd_;
+    Sender sender_;
+    Queued queued_;
+    Answered answered_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<OutboxEntry> queue_;     // Guarded by mutex_, oldest first
+    std::mt19937_64 random_;            // Guarded by mutex_
+    bool stopping_;
+    std::thread thread_;
+};
+
+#endif /* outbox_hpp */
@@ -0,0 +1,83 @@
+//
+//  poll_scheduler.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "poll_scheduler.hpp"
+#include <algorithm>
+
+namespace {
+
+// First retry delay after the server stopped answering
+const PollScheduler::Duration MIN_BACKOFF(500);
+
+// Holds are shortened by up to this fraction, back-off delays by up to half
+const double HOLD_SPREAD = 0.2;
+const double BACKOFF_SPREAD = 0.5;
+
+}
+
+/**
+ * @param minHold Hold used while the chat is active.
+ * @param maxHold Ceiling the hold grows to while the chat is idle.
+ * @param maxBackoff Ceiling of the delay between retries while requests fail.
+ */
+PollScheduler::PollScheduler(Duration minHold, Duration maxHold, Duration maxBackoff)
+    : minHold_(minHold), maxHold_(std::max(minHold, maxHold)), maxBackoff_(std::max(MIN_BACKOFF, maxBackoff)),
+      hold_(minHold), backoff_(0), random_(std::random_device{}()){}
+
+/**
+ * A poll brought messages: poll again at once with the shortest hold.
+ */
+void PollScheduler::Activity(){
+    backoff_ = Duration(0);
+    hold_ = minHold_;
+}
+
+/**
+ * A poll was held until it expired without messages: hold the next one longer.
+ */
+void PollScheduler::Idle(){
+    backoff_ = Duration(0);
+    hold_ = std::min(hold_ * 2, maxHold_);
+}
+
+/**
+ * A poll failed: wait before the next one, twice as long as after the previous failure.
+ */
+void PollScheduler::Failure(){
+    backoff_ = backoff_.count() == 0 ? MIN_BACKOFF : std::min(backoff_ * 2, maxBackoff_);
+}
+
+/**
+ * How long to wait before sending the next poll; zero unless requests are failing.
+ */
+PollScheduler::Duration PollScheduler::Delay(){
+    if(backoff_.count() == 0) return backoff_;
+    return Jitter(backoff_, BACKOFF_SPREAD);
+}
+
+/**
+ * How long the server may hold the next poll open.
+ */
+PollScheduler::Duration PollScheduler::Hold(){
+    return Jitter(hold_, HOLD_SPREAD);
+}
+
+/**
+ * Current time between polls of an idle chat, or between retries while
+ * requests fail, before jitter.
+ */
+PollScheduler::Duration PollScheduler::Interval() const{
+    return backoff_.count() > 0 ? backoff_ : hold_;
+}
+
+/**
+ * Shortens duration by a random fraction of at most spread.
+ */
+PollScheduler::Duration PollScheduler::Jitter(Duration duration, double spread){
+    std::uniform_real_distribution<double> cut(0.0, spread);
+    return Duration((long long)(duration.count() * (1.0 - cut(random_))));
+}
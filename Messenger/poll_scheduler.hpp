@@ -0,0 +1,53 @@
+//
+//  poll_scheduler.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef poll_scheduler_hpp
+#define poll_scheduler_hpp
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+/**
+ * Decides when the next long-poll for a chat goes out and how long the
+ * server may hold it.
+ *
+ * While messages keep arriving the next poll follows at once with the
+ * shortest hold, so a busy chat sees each message one round-trip after it
+ * is sent. Every poll that comes back empty doubles the hold up to the
+ * ceiling, so an idle chat costs fewer and fewer requests. Failures back
+ * off exponentially before retrying. Holds and back-off delays are
+ * randomized, so clients that started together, or all lost the server at
+ * once, do not come back in lockstep. Used by one thread at a time.
+ */
+class PollScheduler{
+public:
+    using Duration = std::chrono::milliseconds;
+
+    PollScheduler(Duration minHold, Duration maxHold, Duration maxBackoff);
+
+    void Activity();
+    void Idle();
+    void Failure();
+
+    Duration Delay();
+    Duration Hold();
+    Duration Interval() const;
+    bool Failing() const { return backoff_.count() > 0; }
+
+private:
+    Duration Jitter(Duration duration, double spread);
+
+    Duration minHold_;
+    Duration maxHold_;
+    Duration maxBackoff_;
+    Duration hold_;         // Before jitter
+    Duration backoff_;      // Zero while the server answers
+    std::mt19937 random_;
+};
+
+#endif /* poll_scheduler_hpp */
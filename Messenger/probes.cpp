@@ -0,0 +1,26 @@
+//
+//  probes.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "probes.hpp"
+
+#ifdef MESSENGER_HAS_SEMAPHORES
+
+// One per probe in probes.hpp. Tracers find them through the probe notes and
+// count themselves in and out, so they live in the .probes section.
+#define MESSENGER_PROBE_SEMAPHORE_DEFINE(name) volatile unsigned short messenger_##name##_semaphore __attribute__((section(".probes"))) = 0
+
+MESSENGER_PROBE_SEMAPHORE_DEFINE(request_start);
+MESSENGER_PROBE_SEMAPHORE_DEFINE(request_end);
+MESSENGER_PROBE_SEMAPHORE_DEFINE(parse_start);
+MESSENGER_PROBE_SEMAPHORE_DEFINE(parse_end);
+MESSENGER_PROBE_SEMAPHORE_DEFINE(refresh);
+MESSENGER_PROBE_SEMAPHORE_DEFINE(render_start);
+MESSENGER_PROBE_SEMAPHORE_DEFINE(render_end);
+MESSENGER_PROBE_SEMAPHORE_DEFINE(message_send);
+MESSENGER_PROBE_SEMAPHORE_DEFINE(message_ack);
+
+#endif
@@ -0,0 +1,88 @@
+//
+//  probes.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef probes_hpp
+#define probes_hpp
+
+#include <stdio.h>
+
+/**
+ * USDT probe points of the "messenger" provider, for bpftrace, perf or
+ * SystemTap to attach to a running client, e.g.
+ *
+ *   bpftrace -e 'usdt:./messenger:messenger:request_end { @[str(arg0)] = hist(arg4); }'
+ *
+ * Where <sys/sdt.h> is available (systemtap-sdt-dev) each probe compiles to
+ * a nop plus a note in the binary. On Linux every probe also has a
+ * semaphore that the tracer raises while attached: until then a probe costs
+ * one load and branch, and neither its arguments nor the clock readings of
+ * MESSENGER_PROBE_NOW(name) are computed. Elsewhere the probes compile to
+ * nothing and their arguments are not evaluated.
+ *
+ * Probes and arguments:
+ *   request_start(path, id, sent bytes)
+ *   request_end(path, id, curl result, http status, total us, received bytes)
+ *   parse_start(received bytes)
+ *   parse_end(received bytes, us)
+ *   refresh(messages, ok)
+ *   render_start(rows)
+ *   render_end(rows, us)
+ *   message_send(clientId, bytes)
+ *   message_ack(clientId, ok, us)
+ * Strings are passed as const char*; read them with str().
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#if defined(__linux__)
+// Probe notes refer to messenger_<probe>_semaphore, defined in probes.cpp
+#define _SDT_HAS_SEMAPHORES 1
+#define MESSENGER_HAS_SEMAPHORES 1
+#endif
+#include <sys/sdt.h>
+#define MESSENGER_HAS_PROBES 1
+#endif
+#endif
+
+#ifdef MESSENGER_HAS_SEMAPHORES
+#define MESSENGER_PROBE_SEMAPHORE(name) extern "C" volatile unsigned short messenger_##name##_semaphore
+MESSENGER_PROBE_SEMAPHORE(request_start);
+MESSENGER_PROBE_SEMAPHORE(request_end);
+MESSENGER_PROBE_SEMAPHORE(parse_start);
+MESSENGER_PROBE_SEMAPHORE(parse_end);
+MESSENGER_PROBE_SEMAPHORE(refresh);
+MESSENGER_PROBE_SEMAPHORE(render_start);
+MESSENGER_PROBE_SEMAPHORE(render_end);
+MESSENGER_PROBE_SEMAPHORE(message_send);
+MESSENGER_PROBE_SEMAPHORE(message_ack);
+// True while a tracer is attached to the probe
+#define MESSENGER_PROBE_ENABLED(name) __builtin_expect(messenger_##name##_semaphore != 0, 0)
+#elif defined(MESSENGER_HAS_PROBES)
+#define MESSENGER_PROBE_ENABLED(name) 1
+#else
+#define MESSENGER_PROBE_ENABLED(name) 0
+#endif
+
+#ifdef MESSENGER_HAS_PROBES
+#include <chrono>
+// Microseconds on the monotonic clock, for the durations the named probe carries; 0 while it is not
+// enabled, so the first duration after a tracer attaches mid-operation is meaningless
+#define MESSENGER_PROBE_NOW(name) (MESSENGER_PROBE_ENABLED(name) ? (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() : 0ULL)
+#define MESSENGER_PROBE1(name, a) do { if (MESSENGER_PROBE_ENABLED(name)) DTRACE_PROBE1(messenger, name, a); } while (0)
+#define MESSENGER_PROBE2(name, a, b) do { if (MESSENGER_PROBE_ENABLED(name)) DTRACE_PROBE2(messenger, name, a, b); } while (0)
+#define MESSENGER_PROBE3(name, a, b, c) do { if (MESSENGER_PROBE_ENABLED(name)) DTRACE_PROBE3(messenger, name, a, b, c); } while (0)
+#define MESSENGER_PROBE6(name, a, b, c, d, e, f) do { if (MESSENGER_PROBE_ENABLED(name)) DTRACE_PROBE6(messenger, name, a, b, c, d, e, f); } while (0)
+#else
+#define MESSENGER_PROBE_NOW(name) 0ULL
+// sizeof keeps the arguments from being evaluated while still counting them as used
+#define MESSENGER_PROBE1(name, a) ((void)sizeof(a))
+#define MESSENGER_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define MESSENGER_PROBE3(name, a, b, c) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#define MESSENGER_PROBE6(name, a, b, c, d, e, f) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d), (void)sizeof(e), (void)sizeof(f))
+#endif
+
+#endif /* probes_hpp */
@@ -0,0 +1,243 @@
+//
+//  reactor.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "reactor.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+namespace {
+
+// Most events handled per epoll_wait call
+const int MAX_EVENTS = 64;
+
+void Drain(int fd){
+    char buffer[64];
+    while(read(fd, buffer, sizeof(buffer)) > 0){}
+}
+
+}
+
+Reactor::Reactor() : pollFd_(-1), timerFd_(-1), wakeRead_(-1), wakeWrite_(-1), nextTimer_(1){
+#ifdef __linux__
+    pollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wakeRead_ = wakeWrite_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    for(int fd : {timerFd_, wakeRead_}){
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(pollFd_, EPOLL_CTL_ADD, fd, &event);
+    }
+#else
+    int fds[2];
+    if(pipe(fds) == 0){
+        wakeRead_ = fds[0];
+        wakeWrite_ = fds[1];
+        fcntl(wakeRead_, F_SETFL, O_NONBLOCK);
+        fcntl(wakeWrite_, F_SETFL, O_NONBLOCK);
+    }
+#endif
+}
+
+Reactor::~Reactor(){
+    if(pollFd_ >= 0) close(pollFd_);
+    if(timerFd_ >= 0) close(timerFd_);
+    if(wakeWrite_ >= 0 && wakeWrite_ != wakeRead_) close(wakeWrite_);
+    if(wakeRead_ >= 0) close(wakeRead_);
+}
+
+/**
+ * Calls handler whenever fd becomes ready for events; watching an fd again
+ * replaces its events and handler.
+ *
+ * @param events Readable, Writable or both.
+ * @param handler Receives the events that are ready; errors and hang-ups report as Readable.
+ */
+void Reactor::Watch(int fd, int events, Handler handler){
+    bool known = watches_.count(fd) > 0;
+    watches_[fd] = Watcher{events, std::move(handler)};
+#ifdef __linux__
+    epoll_event event{};
+    event.events = (events & Readable ? (int)EPOLLIN : 0) | (events & Writable ? (int)EPOLLOUT : 0);
+    event.data.fd = fd;
+    epoll_ctl(pollFd_, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+#else
+    (void)known;
+#endif
+}
+
+/**
+ * Stops watching fd. Must be called before fd is closed.
+ */
+void Reactor::Unwatch(int fd){
+    if(watches_.erase(fd) == 0) return;
+#ifdef __linux__
+    epoll_ctl(pollFd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+}
+
+/**
+ * Runs callback once after delay.
+ *
+ * @return Id for CancelTimer().
+ */
+std::uint64_t Reactor::AddTimer(std::chrono::milliseconds delay, Callback callback){
+    std::uint64_t id = nextTimer_++;
+    timers_.emplace(Clock::now() + delay, std::make_pair(id, std::move(callback)));
+    ArmTimer();
+    return id;
+}
+
+/**
+ * Drops a timer that has not fired yet.
+ */
+void Reactor::CancelTimer(std::uint64_t id){
+    for(auto it = timers_.begin(); it != timers_.end(); ++it){
+        if(it->second.first == id){
+            timers_.erase(it);
+            ArmTimer();
+            return;
+        }
+    }
+}
+
+/**
+ * Queues callback to run on the loop thread. Safe to call from any thread.
+ */
+void Reactor::Post(Callback callback){
+    {
+        std::lock_guard<std::mutex> lock(postMutex_);
+        posted_.push_back(std::move(callback));
+    }
+#ifdef __linux__
+    std::uint64_t one = 1;
+    ssize_t written = write(wakeWrite_, &one, sizeof(one));
+#else
+    char byte = 0;
+    ssize_t written = write(wakeWrite_, &byte, 1);
+#endif
+    (void)written; // A full pipe or counter already guarantees a wakeup
+}
+
+/**
+ * Dispatches events on the calling thread until done() returns true.
+ * done is checked after every batch of events.
+ */
+void Reactor::RunUntil(const std::function<bool()>& done){
+    RunPosted();
+    while(!done()){
+        Wait();
+        RunTimers();
+        RunPosted();
+    }
+}
+
+/**
+ * Blocks until a watched fd is ready, a timer is due or something was posted,
+ * and runs the fd handlers.
+ */
+void Reactor::Wait(){
+#ifdef __linux__
+    epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(pollFd_, events, MAX_EVENTS, -1);
+    for(int i = 0; i < count; i++){
+        int fd = events[i].data.fd;
+        if(fd == timerFd_ || fd == wakeRead_){
+            Drain(fd);
+            continue;
+        }
+        // An earlier handler in this batch may have unwatched it
+        auto it = watches_.find(fd);
+        if(it == watches_.end()) continue;
+
+        int ready = 0;
+        if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ready |= Readable;
+        if(events[i].events & EPOLLOUT) ready |= Writable;
+        Handler handler = it->second.handler;
+        handler(ready);
+    }
+#else
+    std::vector<pollfd> fds;
+    fds.push_back({wakeRead_, POLLIN, 0});
+    for(auto& [fd, watcher] : watches_){
+        short events = (watcher.events & Readable ? POLLIN : 0) | (watcher.events & Writable ? POLLOUT : 0);
+        fds.push_back({fd, events, 0});
+    }
+
+    int timeout = -1;
+    if(!timers_.empty()){
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(timers_.begin()->first - Clock::now());
+        timeout = std::max<long long>(wait.count(), 0);
+    }
+    if(poll(fds.data(), fds.size(), timeout) <= 0) return;
+
+    if(fds[0].revents) Drain(wakeRead_);
+    for(std::size_t i = 1; i < fds.size(); i++){
+        if(!fds[i].revents) continue;
+        auto it = watches_.find(fds[i].fd);
+        if(it == watches_.end()) continue;
+
+        int ready = 0;
+        if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) ready |= Readable;
+        if(fds[i].revents & POLLOUT) ready |= Writable;
+        Handler handler = it->second.handler;
+        handler(ready);
+    }
+#endif
+}
+
+/**
+ * Fires every timer that is due.
+ */
+void Reactor::RunTimers(){
+    bool fired = false;
+    while(!timers_.empty() && timers_.begin()->first <= Clock::now()){
+        Callback callback = std::move(timers_.begin()->second.second);
+        timers_.erase(timers_.begin());
+        callback();
+        fired = true;
+    }
+    if(fired) ArmTimer();
+}
+
+void Reactor::RunPosted(){
+    std::vector<Callback> posted;
+    {
+        std::lock_guard<std::mutex> lock(postMutex_);
+        posted.swap(posted_);
+    }
+    for(Callback& callback : posted){
+        callback();
+    }
+}
+
+/**
+ * Points the timerfd at the earliest timer, or disarms it.
+ */
+void Reactor::ArmTimer(){
+#ifdef __linux__
+    itimerspec spec{};
+    if(!timers_.empty()){
+        auto deadline = std::chrono::duration_cast<std::chrono::nanoseconds>(timers_.begin()->first.time_since_epoch()).count();
+        // An all-zero value would disarm the timer instead of firing it now
+        if(deadline <= 0) deadline = 1;
+        spec.it_value.tv_sec = deadline / 1000000000;
+        spec.it_value.tv_nsec = deadline % 1000000000;
+    }
+    timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+#endif
+}
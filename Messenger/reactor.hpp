@@ -0,0 +1,77 @@
+//
+//  reactor.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef reactor_hpp
+#define reactor_hpp
+
+#include <stdio.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * Single-threaded event loop over file descriptors, timers and posted tasks.
+ *
+ * On Linux it waits in epoll_wait with a timerfd for the earliest timer and
+ * an eventfd for Post(); elsewhere it falls back to poll() with a self-pipe.
+ * With nothing to do it sleeps without any timeout, so an idle loop costs
+ * no wakeups. Everything except Post() must be called on the loop thread.
+ */
+class Reactor{
+public:
+    enum Events{
+        Readable = 1,
+        Writable = 2
+    };
+
+    using Handler = std::function<void(int events)>;
+    using Callback = std::function<void()>;
+
+    Reactor();
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    void Watch(int fd, int events, Handler handler);
+    void Unwatch(int fd);
+
+    std::uint64_t AddTimer(std::chrono::milliseconds delay, Callback callback);
+    void CancelTimer(std::uint64_t id);
+
+    void Post(Callback callback);
+    void RunUntil(const std::function<bool()>& done);
+
+private:
+    struct Watcher{
+        int events;
+        Handler handler;
+    };
+    using Clock = std::chrono::steady_clock;
+
+    void Wait();
+    void RunTimers();
+    void RunPosted();
+    void ArmTimer();
+
+    int pollFd_;        // epoll instance, -1 with the poll() fallback
+    int timerFd_;       // timerfd for the earliest timer, -1 with the poll() fallback
+    int wakeRead_;      // eventfd, or read end of the self-pipe
+    int wakeWrite_;     // Same as wakeRead_ for an eventfd
+
+    std::map<int, Watcher> watches_;
+    std::multimap<Clock::time_point, std::pair<std::uint64_t, Callback>> timers_;
+    std::uint64_t nextTimer_;
+
+    std::mutex postMutex_;
+    std::vector<Callback> posted_;      // Guarded by postMutex_
+};
+
+#endif /* reactor_hpp */
@@ -0,0 +1,173 @@
+//
+//  request_stats.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "request_stats.hpp"
+#include <fstream>
+#include <functional>
+#include "json-2.hpp"
+#include "thread_pool.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+/**
+ * Formats microseconds as milliseconds with one decimal.
+ */
+std::string Millis(std::uint64_t us){
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f", us / 1000.0);
+    return text;
+}
+
+/**
+ * Formats a byte count as kilobytes with one decimal.
+ */
+std::string Kilobytes(std::uint64_t bytes){
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f", bytes / 1024.0);
+    return text;
+}
+
+/**
+ * Summary of a histogram for the JSON dump.
+ */
+json Summary(const LatencyHistogram& histogram){
+    return json::parse(histogram.Json());
+}
+
+}
+
+RequestStats& RequestStats::Shared(){
+    static RequestStats stats;
+    return stats;
+}
+
+RequestStats::~RequestStats(){
+    for(auto& slot : slots_){
+        delete slot.load();
+    }
+}
+
+/**
+ * Adds a finished request to the statistics of its endpoint. Requests to
+ * more distinct paths than the table holds are not counted.
+ */
+void RequestStats::Record(const std::string& path, const RequestSample& sample){
+    EndpointStats* endpoint = Find(path);
+    if(!endpoint) return;
+    if(!sample.ok){
+        endpoint->failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    endpoint->nameLookupUs.Record(sample.nameLookupUs);
+    endpoint->connectUs.Record(sample.connectUs);
+    endpoint->firstByteUs.Record(sample.firstByteUs);
+    endpoint->totalUs.Record(sample.totalUs);
+    endpoint->sentBytes.Record(sample.sentBytes);
+    endpoint->receivedBytes.Record(sample.receivedBytes);
+    endpoint->wireBytes.fetch_add(sample.receivedBytes, std::memory_order_relaxed);
+    endpoint->decodedBytes.fetch_add(sample.decodedBytes, std::memory_order_relaxed);
+}
+
+/**
+ * Returns the endpoint for path, adding it on first use. Lock-free: a slot
+ * is claimed with compare-and-swap, and a thread that loses the race for
+ * a slot keeps probing.
+ */
+EndpointStats* RequestStats::Find(const std::string& path){
+    std::size_t start = std::hash<std::string>{}(path) % SLOTS;
+    EndpointStats* created = nullptr;
+    for(std::size_t i = 0; i < SLOTS; i++){
+        std::atomic<EndpointStats*>& slot = slots_[(start + i) % SLOTS];
+        EndpointStats* current = slot.load(std::memory_order_acquire);
+        if(!current){
+            if(!created) created = new EndpointStats(path);
+            if(slot.compare_exchange_strong(current, created, std::memory_order_acq_rel)) return created;
+        }
+        if(current->path == path){
+            delete created;
+            return current;
+        }
+    }
+    delete created;
+    return nullptr;
+}
+
+/**
+ * Human-readable summary, two lines per endpoint, for the /stats command.
+ */
+std::vector<std::string> RequestStats::Report() const{
+    std::vector<std::string> lines;
+    for(const auto& slot : slots_){
+        const EndpointStats* endpoint = slot.load(std::memory_order_acquire);
+        if(!endpoint) continue;
+        lines.push_back(endpoint->path + ": " + std::to_string(endpoint->totalUs.Count()) + " ok, "
+                        + std::to_string(endpoint->failed.load(std::memory_order_relaxed)) + " failed, bytes p50/p99 out "
+                        + std::to_string(endpoint->sentBytes.Percentile(50)) + "/" + std::to_string(endpoint->sentBytes.Percentile(99)) + " in "
+                        + std::to_string(endpoint->receivedBytes.Percentile(50)) + "/" + std::to_string(endpoint->receivedBytes.Percentile(99))
+                        + ", KB in wire/decoded " + Kilobytes(endpoint->wireBytes.load(std::memory_order_relaxed))
+                        + "/" + Kilobytes(endpoint->decodedBytes.load(std::memory_order_relaxed)));
+
+        std::string times = "  ms p50/p99:";
+        const std::pair<const char*, const LatencyHistogram*> phases[] = {
+            {"dns", &endpoint->nameLookupUs}, {"connect", &endpoint->connectUs},
+            {"first byte", &endpoint->firstByteUs}, {"total", &endpoint->totalUs}
+        };
+        for(const auto& [name, histogram] : phases){
+            times += std::string(" ") + name + " " + Millis(histogram->Percentile(50)) + "/" + Millis(histogram->Percentile(99));
+        }
+        lines.push_back(times);
+    }
+    if(lines.empty()) lines.push_back("No requests yet");
+    return lines;
+}
+
+/**
+ * All endpoints as a JSON object keyed by path, along with the ChatLatency
+ * histograms and the shared ThreadPool's counters. Times are in microseconds.
+ */
+std::string RequestStats::Json() const{
+    json endpoints = json::object();
+    for(const auto& slot : slots_){
+        const EndpointStats* endpoint = slot.load(std::memory_order_acquire);
+        if(!endpoint) continue;
+        endpoints[endpoint->path] = json{
+            {"failed", endpoint->failed.load(std::memory_order_relaxed)},
+            {"nameLookupUs", Summary(endpoint->nameLookupUs)},
+            {"connectUs", Summary(endpoint->connectUs)},
+            {"firstByteUs", Summary(endpoint->firstByteUs)},
+            {"totalUs", Summary(endpoint->totalUs)},
+            {"sentBytes", Summary(endpoint->sentBytes)},
+            {"receivedBytes", Summary(endpoint->receivedBytes)},
+            {"wireBytes", endpoint->wireBytes.load(std::memory_order_relaxed)},
+            {"decodedBytes", endpoint->decodedBytes.load(std::memory_order_relaxed)}
+        };
+    }
+    ThreadPoolStats pool = ThreadPool::Shared().Stats();
+    json poolJson = {
+        {"threads", pool.threads},
+        {"executed", pool.executed},
+        {"stolen", pool.stolen},
+        {"averageWaitUs", pool.averageWaitUs},
+        {"maxWaitUs", pool.maxWaitUs},
+        {"averageRunUs", pool.averageRunUs}
+    };
+    return json{{"endpoints", endpoints}, {"chat", json::parse(ChatLatency::Shared().Json())}, {"pool", poolJson}}.dump(2);
+}
+
+/**
+ * Writes Json() to a file, replacing it.
+ *
+ * @return False if the file could not be written.
+ */
+bool RequestStats::Dump(const std::string& file) const{
+    std::ofstream out(file, std::ios::trunc);
+    if(!out) return false;
+    out << Json() << "\n";
+    return (bool)out;
+}
@@ -0,0 +1,85 @@
+//
+//  request_stats.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef request_stats_hpp
+#define request_stats_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "latency_histogram.hpp"
+
+/**
+ * Measurements of one finished request, taken from libcurl's timing info.
+ * Times are in microseconds since the request started; with a reused
+ * connection the name lookup and connect times are close to zero.
+ */
+struct RequestSample{
+    bool ok = false;                    // Transfer completed and the server did not answer with an error
+    std::uint64_t nameLookupUs = 0;
+    std::uint64_t connectUs = 0;
+    std::uint64_t firstByteUs = 0;      // Until the first response byte: connect plus server time
+    std::uint64_t totalUs = 0;
+    std::uint64_t sentBytes = 0;
+    std::uint64_t receivedBytes = 0;    // Response body as sent, before decompression
+    std::uint64_t decodedBytes = 0;     // Response body after decompression
+};
+
+/**
+ * Timing and size histograms of the requests to one endpoint path.
+ */
+struct EndpointStats{
+    explicit EndpointStats(const std::string& path) : path(path){}
+
+    const std::string path;
+    std::atomic<std::uint64_t> failed{0};
+    LatencyHistogram nameLookupUs;
+    LatencyHistogram connectUs;
+    LatencyHistogram firstByteUs;
+    LatencyHistogram totalUs;
+    LatencyHistogram sentBytes;
+    LatencyHistogram receivedBytes;
+    // Response body totals; wire against decoded shows what compression saves
+    std::atomic<std::uint64_t> wireBytes{0};
+    std::atomic<std::uint64_t> decodedBytes{0};
+};
+
+/**
+ * Process-wide request statistics, one EndpointStats per path.
+ *
+ * HttpClient records every finished request here. Endpoints are found in a
+ * small fixed table with atomic slots, so recording never takes a lock and
+ * never waits for a reader. Endpoints live until the program exits.
+ */
+class RequestStats{
+public:
+    static RequestStats& Shared();
+
+    RequestStats() = default;
+    ~RequestStats();
+
+    RequestStats(const RequestStats&) = delete;
+    RequestStats& operator=(const RequestStats&) = delete;
+
+    void Record(const std::string& path, const RequestSample& sample);
+
+    std::vector<std::string> Report() const;
+    std::string Json() const;
+    bool Dump(const std::string& file) const;
+
+private:
+    static const std::size_t SLOTS = 32;
+
+    EndpointStats* Find(const std::string& path);
+
+    std::atomic<EndpointStats*> slots_[SLOTS] = {};
+};
+
+#endif /* request_stats_hpp */
@@ -0,0 +1,276 @@
+//
+//  screen_renderer.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "screen_renderer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+// Used when the output is not a terminal
+const int DEFAULT_ROWS = 24;
+const int DEFAULT_COLUMNS = 80;
+
+/**
+ * Escape sequence moving the cursor to the start of a 1-based row.
+ */
+std::string MoveTo(int row){
+    return "\x1b[" + std::to_string(row) + ";1H";
+}
+
+// Self-pipe the SIGWINCH handler writes to, see ScreenRenderer::ResizeEvents
+int resizeRead = -1;
+int resizeWrite = -1;
+
+void OnResize(int){
+    int saved = errno;
+    char byte = 0;
+    ssize_t written = write(resizeWrite, &byte, 1);
+    (void)written; // A full pipe already has a resize pending
+    errno = saved;
+}
+
+/**
+ * Writes the whole buffer to stdout, retrying short writes.
+ */
+void WriteAll(const std::string& out){
+    std::size_t offset = 0;
+    while(offset < out.size()){
+        ssize_t written = write(STDOUT_FILENO, out.data() + offset, out.size() - offset);
+        if(written < 0){
+            if(errno == EINTR) continue;
+            return;
+        }
+        offset += written;
+    }
+}
+
+}
+
+ScreenRenderer::ScreenRenderer() : rows_(0), columns_(0), painted_(false){}
+
+/**
+ * Gives the terminal back its full scrolling region and leaves the cursor below the chat.
+ */
+ScreenRenderer::~ScreenRenderer(){
+    if(painted_){
+        WriteAll("\x1b[r" + MoveTo(rows_) + "\r\n");
+    }
+}
+
+/**
+ * Returns how many chat lines fit on screen above the prompt.
+ */
+std::size_t ScreenRenderer::Rows(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Measure();
+    return rows_ - 1;
+}
+
+/**
+ * Splits line into rows that fit the screen width, breaking after the last
+ * space that fits where there is one, and blanks out control characters
+ * like Fit(). Counts UTF-8 code points, not bytes.
+ *
+ * @return At least one row; an empty line gives one empty row.
+ */
+std::vector<std::string> ScreenRenderer::Wrap(const std::string& line){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Measure();
+    // The last column is left free, as in Fit()
+    std::size_t width = columns_ > 1 ? columns_ - 1 : 1;
+
+    std::vector<std::string> rows(1);
+    std::size_t count = 0;                      // Code points in rows.back()
+    std::size_t space = std::string::npos;      // Byte offset just past the last space in rows.back()
+    std::size_t spaceCount = 0;                 // Code points up to there
+    for(unsigned char c : line){
+        bool continuation = (c & 0xC0) == 0x80;
+        if(!continuation && count == width){
+            // Full: the word being written moves to the next row, unless it fills the whole row
+            std::string rest;
+            if(space != std::string::npos && space < rows.back().size()){
+                rest = rows.back().substr(space);
+                rows.back().erase(space);
+                count -= spaceCount;
+            } else {
+                count = 0;
+            }
+            rows.push_back(std::move(rest));
+            space = std::string::npos;
+        }
+        if(!continuation) count++;
+        char shown = c < 0x20 || c == 0x7F ? ' ' : (char)c;
+        rows.back() += shown;
+        if(shown == ' '){
+            space = rows.back().size();
+            spaceCount = count;
+        }
+    }
+    return rows;
+}
+
+/**
+ * Shows lines top to bottom above the prompt. Lines past Rows() are not
+ * shown and long lines are cut at the screen width; Wrap() them first to
+ * keep all of their text. The cursor and any text being typed at the
+ * prompt are left where they are.
+ *
+ * @param lines Text of each row, without newlines.
+ */
+void ScreenRenderer::Render(const std::vector<std::string>& lines){
+    std::lock_guard<std::mutex> lock(mutex_);
+    Measure();
+
+    std::vector<std::string> rows(rows_ - 1);
+    for(std::size_t i = 0; i < rows.size() && i < lines.size(); i++){
+        rows[i] = Fit(lines[i]);
+    }
+
+    std::string out;
+    if(!painted_){
+        shown_ = std::move(rows);
+        Paint(out);
+    } else {
+        // New messages push the chat up: let the terminal scroll and only write the rows that came in
+        std::size_t shift = ScrollShift(rows);
+        if(shift > 0){
+            out = "\x1b" "7\x1b[" + std::to_string(shift) + "S";
+            shown_.erase(shown_.begin(), shown_.begin() + shift);
+            shown_.resize(rows.size());
+        }
+        for(std::size_t i = 0; i < rows.size(); i++){
+            if(rows[i] == shown_[i]) continue;
+            if(out.empty()) out = "\x1b" "7"; // Save the cursor at the prompt
+            out += MoveTo(i + 1) + rows[i] + "\x1b[K";
+            shown_[i] = std::move(rows[i]);
+        }
+        if(!out.empty()) out += "\x1b" "8";
+    }
+    WriteAll(out);
+}
+
+/**
+ * Replaces the prompt row with text and leaves the cursor after it.
+ */
+void ScreenRenderer::Prompt(const std::string& text){
+    std::lock_guard<std::mutex> lock(mutex_);
+    prompt_ = text;
+    Measure();
+
+    std::string out;
+    if(!painted_){
+        Paint(out);
+    } else {
+        out = MoveTo(rows_) + Fit(prompt_) + "\x1b[K";
+    }
+    WriteAll(out);
+}
+
+/**
+ * Returns a descriptor that becomes readable whenever the terminal is
+ * resized, for a Reactor to watch. The first call installs the SIGWINCH
+ * handler. Call TakeResizeEvents() once it was readable, then redraw.
+ *
+ * @return Read end of a non-blocking pipe, or -1 if none could be created.
+ */
+int ScreenRenderer::ResizeEvents(){
+    static bool installed = [](){
+        int fds[2];
+        if(pipe(fds) != 0) return false;
+        for(int fd : fds){
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        resizeRead = fds[0];
+        resizeWrite = fds[1];
+
+        struct sigaction action{};
+        action.sa_handler = OnResize;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        return sigaction(SIGWINCH, &action, nullptr) == 0;
+    }();
+    return installed ? resizeRead : -1;
+}
+
+/**
+ * Empties the ResizeEvents() pipe; several resizes in a row need one redraw.
+ */
+void ScreenRenderer::TakeResizeEvents(){
+    char buffer[64];
+    while(resizeRead >= 0 && read(resizeRead, buffer, sizeof(buffer)) > 0){}
+}
+
+/**
+ * Tells by how many rows the chat moved up: the smallest shift after which
+ * all rows still on screen keep their text, or 0 if there is none.
+ */
+std::size_t ScreenRenderer::ScrollShift(const std::vector<std::string>& rows) const{
+    if(rows.empty() || rows[0] == shown_[0]) return 0;
+    for(std::size_t shift = 1; shift < rows.size(); shift++){
+        if(shown_[shift] != rows[0] || shown_[shift].empty()) continue;
+        if(std::equal(shown_.begin() + shift, shown_.end(), rows.begin())) return shift;
+    }
+    return 0;
+}
+
+/**
+ * Reads the terminal size; a change forces the next update to repaint everything.
+ */
+void ScreenRenderer::Measure(){
+    int rows = DEFAULT_ROWS;
+    int columns = DEFAULT_COLUMNS;
+    winsize size{};
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0){
+        rows = size.ws_row < 2 ? 2 : size.ws_row;
+        columns = size.ws_col;
+    }
+    if(rows != rows_ || columns != columns_){
+        rows_ = rows;
+        columns_ = columns;
+        painted_ = false;
+    }
+}
+
+/**
+ * Appends a full repaint of shown_ and the prompt to out: clears the screen
+ * and limits scrolling to the chat rows.
+ */
+void ScreenRenderer::Paint(std::string& out){
+    shown_.resize(rows_ - 1);
+    out += "\x1b[r\x1b[H\x1b[2J";
+    out += "\x1b[1;" + std::to_string(rows_ - 1) + "r";
+    for(std::size_t i = 0; i < shown_.size(); i++){
+        shown_[i] = Fit(shown_[i]);
+        if(!shown_[i].empty()) out += MoveTo(i + 1) + shown_[i];
+    }
+    out += MoveTo(rows_) + Fit(prompt_);
+    painted_ = true;
+}
+
+/**
+ * Cuts line to fit in one row and blanks out control characters, so a
+ * message can neither wrap nor move the cursor. Counts UTF-8 code points,
+ * not bytes.
+ */
+std::string ScreenRenderer::Fit(const std::string& line) const{
+    // The last column is left free: writing into it would defer a wrap that \x1b[K then undoes
+    int room = columns_ - 1;
+    std::string fitted;
+    fitted.reserve(line.size());
+    for(unsigned char c : line){
+        bool continuation = (c & 0xC0) == 0x80;
+        if(!continuation && room-- == 0) break;
+        fitted += c < 0x20 || c == 0x7F ? ' ' : (char)c;
+    }
+    return fitted;
+}
@@ -0,0 +1,57 @@
+//
+//  screen_renderer.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef screen_renderer_hpp
+#define screen_renderer_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Draws the chat screen by updating only the rows that changed.
+ *
+ * Keeps a copy of what every terminal row currently shows. Render() compares
+ * the new rows against it and emits cursor-positioning sequences for the
+ * changed rows only, all in one buffer passed to a single write(2); when new
+ * messages push the chat up the terminal scrolls it instead. The last
+ * row holds the input prompt and is left out of the scrolling region, so
+ * pressing Enter does not scroll the chat. Safe to call from several threads.
+ */
+class ScreenRenderer{
+public:
+    ScreenRenderer();
+    ~ScreenRenderer();
+
+    ScreenRenderer(const ScreenRenderer&) = delete;
+    ScreenRenderer& operator=(const ScreenRenderer&) = delete;
+
+    std::size_t Rows();
+    std::vector<std::string> Wrap(const std::string& line);
+    void Render(const std::vector<std::string>& lines);
+    void Prompt(const std::string& text);
+
+    static int ResizeEvents();
+    static void TakeResizeEvents();
+
+private:
+    void Measure();
+    void Paint(std::string& out);
+    std::size_t ScrollShift(const std::vector<std::string>& rows) const;
+    std::string Fit(const std::string& line) const;
+
+    std::mutex mutex_;
+    std::vector<std::string> shown_;    // Chat rows as currently on screen
+    std::string prompt_;
+    int rows_;
+    int columns_;
+    bool painted_;                      // False until the screen was cleared and set up
+};
+
+#endif /* screen_renderer_hpp */
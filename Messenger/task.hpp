@@ -0,0 +1,197 @@
+//
+//  task.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef task_hpp
+#define task_hpp
+
+#include <stdio.h>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Coroutine support for client flows: Task<T> is what a coroutine returns,
+// Awaitable<T> is what a Backend request returns, SyncWait() runs a Task
+// from ordinary blocking code.
+
+/**
+ * Result of an operation that is already running, to be co_awaited once.
+ *
+ * The operation starts when the Awaitable is created, so several requests
+ * can be put in flight before awaiting any of them. The awaiting coroutine
+ * resumes on whichever thread completes the operation.
+ */
+template<typename T>
+class Awaitable{
+public:
+    using Complete = std::function<void(T value)>;
+
+    /**
+     * Creates an Awaitable and the function that completes it. The completer
+     * may be called before or after the Awaitable is awaited, from any thread.
+     */
+    static std::pair<Awaitable, Complete> Make(){
+        auto state = std::make_shared<State>();
+        Complete complete = [state](T value){
+            std::coroutine_handle<> waiter;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->value = std::move(value);
+                waiter = state->waiter;
+            }
+            if(waiter) waiter.resume();
+        };
+        return {Awaitable(state), std::move(complete)};
+    }
+
+    bool await_ready(){
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->value.has_value();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle){
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if(state_->value) return false; // Completed meanwhile, continue without suspending
+        state_->waiter = handle;
+        return true;
+    }
+
+    T await_resume(){
+        return std::move(*state_->value);
+    }
+
+private:
+    struct State{
+        std::mutex mutex;
+        std::optional<T> value;
+        std::coroutine_handle<> waiter;
+    };
+
+    explicit Awaitable(std::shared_ptr<State> state) : state_(std::move(state)){}
+
+    std::shared_ptr<State> state_;
+};
+
+/**
+ * Return type of a coroutine producing a T.
+ * Starts when it is first awaited and resumes the awaiting coroutine when done.
+ */
+template<typename T>
+class Task{
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct FinalAwaiter{
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    struct PromiseBase{
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    struct ValuePromise : PromiseBase{
+        std::optional<T> value;
+        void return_value(T result) { value = std::move(result); }
+    };
+
+    struct VoidPromise : PromiseBase{
+        void return_void() {}
+    };
+
+    struct promise_type : std::conditional_t<std::is_void_v<T>, VoidPromise, ValuePromise>{
+        Task get_return_object() { return Task(Handle::from_promise(*this)); }
+    };
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})){}
+    Task& operator=(Task&& other) noexcept {
+        if(this != &other){
+            if(handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    ~Task(){
+        if(handle_) handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    T await_resume(){
+        if(handle_.promise().error) std::rethrow_exception(handle_.promise().error);
+        if constexpr (!std::is_void_v<T>){
+            return std::move(*handle_.promise().value);
+        }
+    }
+
+private:
+    explicit Task(Handle handle) : handle_(handle){}
+
+    Handle handle_;
+};
+
+/**
+ * Coroutine that starts immediately and owns itself; used by SyncWait.
+ */
+struct DetachedTask{
+    struct promise_type{
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+template<typename T>
+DetachedTask RunInto(Task<T> task, std::promise<T> result){
+    try {
+        if constexpr (std::is_void_v<T>){
+            co_await task;
+            result.set_value();
+        } else {
+            result.set_value(co_await task);
+        }
+    } catch (...) {
+        result.set_exception(std::current_exception());
+    }
+}
+
+/**
+ * Runs a Task and blocks the calling thread until it finishes.
+ *
+ * @return The Task's result; its exception is rethrown.
+ */
+template<typename T>
+T SyncWait(Task<T> task){
+    std::promise<T> result;
+    std::future<T> future = result.get_future();
+    RunInto(std::move(task), std::move(result));
+    return future.get();
+}
+
+#endif /* task_hpp */
@@ -0,0 +1,157 @@
+//
+//  thread_pool.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <iostream>
+#include "trace.hpp"
+
+namespace {
+
+// Pool and queue index of the worker running on this thread, if any
+thread_local ThreadPool* currentPool = nullptr;
+thread_local std::size_t currentIndex = 0;
+
+std::uint64_t Nanoseconds(std::chrono::steady_clock::duration duration){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+}
+
+/**
+ * Process-wide pool sized to the machine, between 2 and 8 workers.
+ */
+ThreadPool& ThreadPool::Shared(){
+    // Never destroyed: HttpClient completions may still submit work while statics are torn down
+    static ThreadPool* pool = new ThreadPool(std::clamp<std::size_t>(std::thread::hardware_concurrency(), 2, 8));
+    return *pool;
+}
+
+/**
+ * Starts the workers.
+ *
+ * @param threads Number of workers, at least one.
+ */
+ThreadPool::ThreadPool(std::size_t threads)
+    : queued_(0), next_(0), stopping_(false), executed_(0), stolen_(0), waitNs_(0), maxWaitNs_(0), runNs_(0){
+    threads = std::max<std::size_t>(threads, 1);
+    for(std::size_t i = 0; i < threads; i++){
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for(std::size_t i = 0; i < threads; i++){
+        workers_[i]->thread = std::thread(&ThreadPool::Run, this, i);
+    }
+}
+
+/**
+ * Runs the tasks still queued, then stops the workers.
+ */
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        stopping_ = true;
+    }
+    idle_.notify_all();
+    for(auto& worker : workers_){
+        if(worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+/**
+ * Queues a task. Never blocks on other tasks.
+ */
+void ThreadPool::Submit(Task task){
+    std::size_t index = currentPool == this ? currentIndex : next_++ % workers_.size();
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back({std::move(task), std::chrono::steady_clock::now()});
+        queued_++;
+    }
+
+    // Taking the lock orders this with a worker that just found nothing and is about to sleep
+    { std::lock_guard<std::mutex> lock(idleMutex_); }
+    idle_.notify_one();
+}
+
+/**
+ * Snapshot of the pool's counters.
+ */
+ThreadPoolStats ThreadPool::Stats() const{
+    ThreadPoolStats stats;
+    stats.threads = workers_.size();
+    stats.queued = queued_;
+    stats.executed = executed_;
+    stats.stolen = stolen_;
+    if(stats.executed > 0){
+        stats.averageWaitUs = waitNs_ / 1000.0 / stats.executed;
+        stats.averageRunUs = runNs_ / 1000.0 / stats.executed;
+    }
+    stats.maxWaitUs = maxWaitNs_ / 1000.0;
+    return stats;
+}
+
+/**
+ * Takes the newest task of worker index, or steals the oldest one of another worker.
+ */
+bool ThreadPool::Take(std::size_t index, Item& item){
+    {
+        Worker& own = *workers_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(!own.tasks.empty()){
+            item = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_--;
+            return true;
+        }
+    }
+    for(std::size_t offset = 1; offset < workers_.size(); offset++){
+        Worker& victim = *workers_[(index + offset) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty()){
+            item = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_--;
+            stolen_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Worker loop: runs tasks until the pool stops and nothing is left.
+ */
+void ThreadPool::Run(std::size_t index){
+    currentPool = this;
+    currentIndex = index;
+    Trace::NameThread("pool");
+
+    while(true){
+        Item item;
+        if(!Take(index, item)){
+            std::unique_lock<std::mutex> lock(idleMutex_);
+            if(stopping_ && queued_ == 0) return;
+            idle_.wait(lock, [this]{ return stopping_ || queued_ > 0; });
+            continue;
+        }
+
+        auto started = std::chrono::steady_clock::now();
+        std::uint64_t wait = Nanoseconds(started - item.queued);
+        try {
+            item.task();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+        }
+        std::uint64_t run = Nanoseconds(std::chrono::steady_clock::now() - started);
+
+        executed_.fetch_add(1, std::memory_order_relaxed);
+        waitNs_.fetch_add(wait, std::memory_order_relaxed);
+        runNs_.fetch_add(run, std::memory_order_relaxed);
+        std::uint64_t max = maxWaitNs_.load(std::memory_order_relaxed);
+        while(wait > max && !maxWaitNs_.compare_exchange_weak(max, wait, std::memory_order_relaxed)){}
+    }
+}
@@ -0,0 +1,106 @@
+//
+//  thread_pool.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef thread_pool_hpp
+#define thread_pool_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Counters of a ThreadPool since it started.
+ */
+struct ThreadPoolStats{
+    std::size_t threads = 0;
+    std::size_t queued = 0;             // Tasks waiting right now
+    std::uint64_t executed = 0;
+    std::uint64_t stolen = 0;           // Tasks run by a worker other than the one they were queued on
+    double averageWaitUs = 0;           // Submit to start
+    double maxWaitUs = 0;
+    double averageRunUs = 0;
+};
+
+/**
+ * Fixed set of worker threads for short background tasks such as response
+ * parsing, so no thread is created per request.
+ *
+ * Each worker owns a queue. Tasks submitted from a worker go to its own
+ * queue and run newest first while their data is still in cache; other
+ * tasks are spread round-robin. An idle worker steals the oldest task from
+ * the other queues before going to sleep. Tasks must not block on each other.
+ */
+class ThreadPool{
+public:
+    using Task = std::function<void()>;
+
+    static ThreadPool& Shared();
+
+    explicit ThreadPool(std::size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(Task task);
+
+    /**
+     * Runs function on the pool.
+     *
+     * @return Future for its result, or for the exception it threw.
+     */
+    template<typename Function>
+    auto Async(Function function) -> std::future<decltype(function())>{
+        using Result = decltype(function());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+        std::future<Result> future = task->get_future();
+        Submit([task](){ (*task)(); });
+        return future;
+    }
+
+    ThreadPoolStats Stats() const;
+    std::size_t Size() const { return workers_.size(); }
+
+private:
+    struct Item{
+        Task task;
+        std::chrono::steady_clock::time_point queued;
+    };
+    struct Worker{
+        std::mutex mutex;
+        std::deque<Item> tasks;     // Guarded by mutex; owner takes from the back, thieves from the front
+        std::thread thread;
+    };
+
+    void Run(std::size_t index);
+    bool Take(std::size_t index, Item& item);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex idleMutex_;
+    std::condition_variable idle_;
+    std::atomic<std::size_t> queued_;
+    std::atomic<std::size_t> next_;
+    std::atomic<bool> stopping_;
+
+    std::atomic<std::uint64_t> executed_;
+    std::atomic<std::uint64_t> stolen_;
+    std::atomic<std::uint64_t> waitNs_;
+    std::atomic<std::uint64_t> maxWaitNs_;
+    std::atomic<std::uint64_t> runNs_;
+};
+
+#endif /* thread_pool_hpp */
@@ -0,0 +1,235 @@
+//
+//  trace.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "json-2.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Events kept per thread; older ones are overwritten
+const std::size_t RING_SIZE = 8192;
+
+/**
+ * One span. Names are copied into the event so recording never allocates.
+ */
+struct Event{
+    std::uint64_t startUs;
+    std::uint64_t endUs;
+    std::uint64_t id;           // Groups async spans, 0 for spans on the thread's own track
+    const char* category;
+    char name[40];
+};
+
+/**
+ * A thread's events. The lock is only ever contended by Flush().
+ */
+struct Ring{
+    std::mutex mutex;
+    std::vector<Event> events = std::vector<Event>(RING_SIZE);
+    std::size_t next = 0;       // Total events written; next % RING_SIZE is the slot
+    int tid = 0;
+    std::string thread;
+};
+
+std::atomic<bool> enabled{false};
+std::string traceFile;
+
+// Rings of every thread that recorded, kept after the thread ends
+std::mutex ringsMutex;
+std::vector<std::shared_ptr<Ring>> rings;
+
+// Self-pipe the SIGUSR1 handler writes to; a flushing thread reads it
+int flushWrite = -1;
+
+void OnFlushSignal(int){
+    int saved = errno;
+    char byte = 0;
+    ssize_t written = write(flushWrite, &byte, 1);
+    (void)written; // A full pipe already has a flush pending
+    errno = saved;
+}
+
+/**
+ * The calling thread's ring, created on first use.
+ */
+Ring& ThreadRing(){
+    thread_local std::shared_ptr<Ring> ring = [](){
+        auto created = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        created->tid = (int)rings.size() + 1;
+        rings.push_back(created);
+        return created;
+    }();
+    return *ring;
+}
+
+void Record(const char* category, std::string_view name, std::uint64_t id, std::uint64_t startUs, std::uint64_t endUs){
+    Ring& ring = ThreadRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    Event& event = ring.events[ring.next++ % RING_SIZE];
+    event.startUs = startUs;
+    event.endUs = std::max(startUs, endUs);
+    event.id = id;
+    event.category = category;
+    std::size_t length = std::min(name.size(), sizeof(event.name) - 1);
+    memcpy(event.name, name.data(), length);
+    event.name[length] = '\0';
+}
+
+}
+
+/**
+ * Turns tracing on. Events are written to file by Flush(), which also runs
+ * on SIGUSR1, so a session that seems stuck can be captured without
+ * stopping it.
+ *
+ * @param file Path of the Chrome trace-event JSON file to write.
+ * @return False if tracing was already on.
+ */
+bool Trace::Start(const std::string& file){
+    if(enabled.exchange(true)) return false;
+    traceFile = file;
+
+    int fds[2];
+    if(pipe(fds) == 0){
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        for(int fd : fds) fcntl(fd, F_SETFD, FD_CLOEXEC);
+        flushWrite = fds[1];
+        std::thread([fd = fds[0]](){
+            NameThread("trace flush");
+            char byte;
+            while(true){
+                ssize_t got = read(fd, &byte, 1);
+                if(got > 0){
+                    Flush();
+                } else if(got < 0 && errno == EINTR){
+                    continue;
+                } else {
+                    return;
+                }
+            }
+        }).detach();
+
+        struct sigaction action{};
+        action.sa_handler = OnFlushSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, nullptr);
+    }
+    return true;
+}
+
+bool Trace::Enabled(){
+    return enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Names the calling thread's track in the trace.
+ */
+void Trace::NameThread(const char* name){
+    if(!Enabled()) return;
+    Ring& ring = ThreadRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.thread = name;
+}
+
+/**
+ * Microseconds on the monotonic clock, the time base of all events.
+ */
+std::uint64_t Trace::Now(){
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+/**
+ * Records a span on the calling thread's track. Spans on one thread should
+ * nest, as they do when they come from TraceSpan.
+ */
+void Trace::Complete(const char* category, std::string_view name, std::uint64_t startUs, std::uint64_t endUs){
+    if(!Enabled()) return;
+    Record(category, name, 0, startUs, endUs);
+}
+
+/**
+ * Records a span that may overlap others on the same thread, such as one
+ * phase of a request; spans with the same category and id share a track.
+ *
+ * @param id Non-zero id tying together the spans of one operation.
+ */
+void Trace::Async(const char* category, std::string_view name, std::uint64_t id, std::uint64_t startUs, std::uint64_t endUs){
+    if(!Enabled() || id == 0) return;
+    Record(category, name, id, startUs, endUs);
+}
+
+/**
+ * Writes the events of all threads to the trace file, replacing it.
+ *
+ * @return False if tracing is off or the file could not be written.
+ */
+bool Trace::Flush(){
+    if(!Enabled()) return false;
+    static std::mutex flushMutex;
+    std::lock_guard<std::mutex> flushLock(flushMutex);
+
+    std::vector<std::shared_ptr<Ring>> all;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        all = rings;
+    }
+
+    json events = json::array();
+    int pid = getpid();
+    for(const std::shared_ptr<Ring>& ring : all){
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        if(!ring->thread.empty()){
+            events.push_back({{"ph", "M"}, {"name", "thread_name"}, {"pid", pid}, {"tid", ring->tid}, {"args", {{"name", ring->thread}}}});
+        }
+        std::size_t count = std::min(ring->next, RING_SIZE);
+        for(std::size_t i = ring->next - count; i < ring->next; i++){
+            const Event& event = ring->events[i % RING_SIZE];
+            json common = {{"name", event.name}, {"cat", event.category}, {"pid", pid}, {"tid", ring->tid}};
+            if(event.id == 0){
+                json complete = common;
+                complete["ph"] = "X";
+                complete["ts"] = event.startUs;
+                complete["dur"] = event.endUs - event.startUs;
+                events.push_back(std::move(complete));
+            } else {
+                // Nestable async begin and end, grouped into one track per id
+                json begin = common;
+                begin["ph"] = "b";
+                begin["ts"] = event.startUs;
+                begin["id"] = event.id;
+                json end = begin;
+                end["ph"] = "e";
+                end["ts"] = event.endUs;
+                events.push_back(std::move(begin));
+                events.push_back(std::move(end));
+            }
+        }
+    }
+
+    std::ofstream out(traceFile, std::ios::trunc);
+    if(!out) return false;
+    out << json{{"traceEvents", events}, {"displayTimeUnit", "ms"}}.dump() << "\n";
+    return (bool)out;
+}
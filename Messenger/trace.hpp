@@ -0,0 +1,59 @@
+//
+//  trace.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef trace_hpp
+#define trace_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * Opt-in timeline of what the client spent its time on, written as a
+ * Chrome trace-event file that Perfetto or chrome://tracing can open.
+ *
+ * Off unless Start() was called, and then every call below returns after
+ * one atomic load. Once on, each thread records into its own fixed-size
+ * ring buffer, allocated on its first event, so the newest events of every
+ * thread are kept and recording takes no shared lock. Flush() writes all
+ * rings to the file; it runs on exit and whenever the process gets SIGUSR1.
+ */
+class Trace{
+public:
+    static bool Start(const std::string& file);
+    static bool Enabled();
+    static bool Flush();
+
+    static void NameThread(const char* name);
+    static std::uint64_t Now();
+
+    static void Complete(const char* category, std::string_view name, std::uint64_t startUs, std::uint64_t endUs);
+    static void Async(const char* category, std::string_view name, std::uint64_t id, std::uint64_t startUs, std::uint64_t endUs);
+};
+
+/**
+ * Records the time from its creation to its destruction as one span on the
+ * calling thread.
+ */
+class TraceSpan{
+public:
+    TraceSpan(const char* category, const char* name) : category_(category), name_(name), start_(Trace::Enabled() ? Trace::Now() : 0){}
+    ~TraceSpan(){
+        if(start_) Trace::Complete(category_, name_, start_, Trace::Now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* category_;
+    const char* name_;
+    std::uint64_t start_;       // 0 while tracing is off
+};
+
+#endif /* trace_hpp */
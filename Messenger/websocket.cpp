@@ -0,0 +1,348 @@
+//
+//  websocket.cpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#include "websocket.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const std::uint8_t OP_CONTINUATION = 0x0;
+const std::uint8_t OP_TEXT = 0x1;
+const std::uint8_t OP_CLOSE = 0x8;
+const std::uint8_t OP_PING = 0x9;
+const std::uint8_t OP_PONG = 0xA;
+
+// Largest message accepted from the server
+const std::uint64_t MAX_MESSAGE = 64ull << 20;
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0; // macOS uses SO_NOSIGPIPE on the socket instead
+#endif
+
+// Appended to the key by the server before hashing, RFC 6455 section 1.3
+const char* ACCEPT_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/**
+ * SHA-1 digest, only needed to check the Sec-WebSocket-Accept header.
+ */
+std::array<unsigned char, 20> Sha1(const std::string& text){
+    std::uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    auto rotate = [](std::uint32_t value, int bits){ return (value << bits) | (value >> (32 - bits)); };
+
+    // Padding: a 1 bit, zeros up to 56 mod 64 bytes, then the length in bits
+    std::string data = text;
+    data += static_cast<char>(0x80);
+    while(data.size() % 64 != 56) data += '\0';
+    std::uint64_t bits = static_cast<std::uint64_t>(text.size()) * 8;
+    for(int shift = 56; shift >= 0; shift -= 8) data += static_cast<char>(bits >> shift);
+
+    for(std::size_t block = 0; block < data.size(); block += 64){
+        std::uint32_t w[80];
+        for(int i = 0; i < 16; i++){
+            const unsigned char* b = reinterpret_cast<const unsigned char*>(data.data() + block + i * 4);
+            w[i] = (std::uint32_t)b[0] << 24 | (std::uint32_t)b[1] << 16 | (std::uint32_t)b[2] << 8 | b[3];
+        }
+        for(int i = 16; i < 80; i++) w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for(int i = 0; i < 80; i++){
+            std::uint32_t f, k;
+            if(i < 20){
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if(i < 40){
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if(i < 60){
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            std::uint32_t next = rotate(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = next;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    std::array<unsigned char, 20> digest;
+    for(int i = 0; i < 20; i++) digest[i] = static_cast<unsigned char>(h[i / 4] >> (24 - 8 * (i % 4)));
+    return digest;
+}
+
+/**
+ * Base64 encoding, only needed for the Sec-WebSocket-Key and -Accept headers.
+ */
+std::string Base64(const unsigned char* data, std::size_t size){
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for(std::size_t i = 0; i < size; i += 3){
+        std::uint32_t chunk = data[i] << 16;
+        if(i + 1 < size) chunk |= data[i + 1] << 8;
+        if(i + 2 < size) chunk |= data[i + 2];
+        out += table[(chunk >> 18) & 63];
+        out += table[(chunk >> 12) & 63];
+        out += i + 1 < size ? table[(chunk >> 6) & 63] : '=';
+        out += i + 2 < size ? table[chunk & 63] : '=';
+    }
+    return out;
+}
+
+/**
+ * Value of a header in a raw HTTP response head, matched case-insensitively, or "" if absent.
+ */
+std::string HeaderValue(const std::string& head, const std::string& name){
+    std::size_t line = head.find("\r\n");
+    while(line != std::string::npos && line + 2 < head.size()){
+        line += 2;
+        std::size_t end = head.find("\r\n", line);
+        if(end == std::string::npos) end = head.size();
+        std::size_t colon = head.find(':', line);
+        if(colon < end && colon - line == name.size() &&
+           std::equal(name.begin(), name.end(), head.begin() + line, [](char a, char b){ return std::tolower((unsigned char)a) == std::tolower((unsigned char)b); })){
+            std::size_t value = head.find_first_not_of(" \t", colon + 1);
+            std::size_t valueEnd = head.find_last_not_of(" \t", end - 1);
+            return value < end && valueEnd >= value ? head.substr(value, valueEnd - value + 1) : "";
+        }
+        line = end;
+    }
+    return "";
+}
+
+bool SendAll(int fd, const char* data, std::size_t size){
+    while(size > 0){
+        ssize_t sent = send(fd, data, size, SEND_FLAGS);
+        if(sent <= 0) return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+}
+
+WebSocket::WebSocket() : fd_(-1), open_(false), random_(std::random_device{}()){}
+
+WebSocket::~WebSocket(){
+    Close();
+}
+
+/**
+ * Opens the TCP connection, performs the upgrade handshake and starts the reader thread.
+ *
+ * @param host Server host name or address.
+ * @param port Server port.
+ * @param path Endpoint path, e.g. "/ws".
+ * @param onMessage Called on the reader thread with each text message.
+ * @param onClose Called on the reader thread once the connection is gone.
+ * @return True if the connection is open.
+ */
+bool WebSocket::Connect(const std::string& host, int port, const std::string& path, MessageHandler onMessage, CloseHandler onClose){
+    Close();
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if(getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) return false;
+
+    for(addrinfo* address = addresses; address; address = address->ai_next){
+        fd_ = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if(fd_ < 0) continue;
+        if(connect(fd_, address->ai_addr, address->ai_addrlen) == 0) break;
+        ::close(fd_);
+        fd_ = -1;
+    }
+    freeaddrinfo(addresses);
+    if(fd_ < 0) return false;
+
+    // Frames are small and latency-sensitive, don't let Nagle batch them
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    readBuffer_.clear();
+    if(!Handshake(host, port, path)){
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    onMessage_ = std::move(onMessage);
+    onClose_ = std::move(onClose);
+    open_ = true;
+    reader_ = std::thread(&WebSocket::ReadLoop, this);
+    return true;
+}
+
+/**
+ * Sends a text message as one frame.
+ *
+ * @return False if the connection is closed or the write failed.
+ */
+bool WebSocket::SendText(const std::string& text){
+    return SendFrame(OP_TEXT, text.data(), text.size());
+}
+
+/**
+ * Closes the connection and waits for the reader thread.
+ * Must not be called from the message or close handler.
+ */
+void WebSocket::Close(){
+    if(fd_ < 0) return;
+    if(open_.exchange(false)){
+        SendFrame(OP_CLOSE, nullptr, 0);
+    }
+    // Unblocks recv() in the reader thread
+    shutdown(fd_, SHUT_RDWR);
+    if(reader_.joinable()) reader_.join();
+
+    std::lock_guard<std::mutex> lock(sendMutex_);
+    ::close(fd_);
+    fd_ = -1;
+}
+
+bool WebSocket::Handshake(const std::string& host, int port, const std::string& path){
+    unsigned char nonce[16];
+    for(unsigned char& byte : nonce) byte = static_cast<unsigned char>(random_());
+    std::string key = Base64(nonce, sizeof(nonce));
+
+    std::string request = "GET " + path + " HTTP/1.1\r\n"
+                          "Host: " + host + ":" + std::to_string(port) + "\r\n"
+                          "Upgrade: websocket\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: " + key + "\r\n"
+                          "Sec-WebSocket-Version: 13\r\n\r\n";
+    if(!SendAll(fd_, request.data(), request.size())) return false;
+
+    // Read the response headers; anything after them already belongs to the first frame
+    std::size_t end = std::string::npos;
+    char chunk[1024];
+    while((end = readBuffer_.find("\r\n\r\n")) == std::string::npos){
+        ssize_t received = recv(fd_, chunk, sizeof(chunk), 0);
+        if(received <= 0 || readBuffer_.size() > 16384) return false;
+        readBuffer_.append(chunk, received);
+    }
+    std::string head = readBuffer_.substr(0, end + 2);
+    readBuffer_.erase(0, end + 4);
+    if(head.compare(0, 12, "HTTP/1.1 101") != 0) return false;
+
+    // Proves the answer comes from a WebSocket server that read this request, not a cache or proxy
+    std::array<unsigned char, 20> expected = Sha1(key + ACCEPT_GUID);
+    return HeaderValue(head, "Sec-WebSocket-Accept") == Base64(expected.data(), expected.size());
+}
+
+bool WebSocket::SendFrame(std::uint8_t opcode, const char* data, std::size_t size){
+    std::lock_guard<std::mutex> lock(sendMutex_);
+    if(fd_ < 0) return false;
+
+    std::string frame;
+    frame.reserve(size + 14);
+    frame += static_cast<char>(0x80 | opcode); // FIN + opcode
+    if(size < 126){
+        frame += static_cast<char>(0x80 | size); // Client frames are always masked
+    } else if(size < 65536){
+        frame += static_cast<char>(0x80 | 126);
+        frame += static_cast<char>(size >> 8);
+        frame += static_cast<char>(size);
+    } else {
+        frame += static_cast<char>(0x80 | 127);
+        for(int shift = 56; shift >= 0; shift -= 8){
+            frame += static_cast<char>(static_cast<std::uint64_t>(size) >> shift);
+        }
+    }
+
+    std::uint32_t maskKey = random_();
+    char mask[4];
+    std::memcpy(mask, &maskKey, 4);
+    frame.append(mask, 4);
+    for(std::size_t i = 0; i < size; i++){
+        frame += static_cast<char>(data[i] ^ mask[i & 3]);
+    }
+    return SendAll(fd_, frame.data(), frame.size());
+}
+
+bool WebSocket::ReadExact(char* out, std::size_t size){
+    char chunk[16384];
+    while(readBuffer_.size() < size){
+        ssize_t received = recv(fd_, chunk, sizeof(chunk), 0);
+        if(received <= 0) return false;
+        readBuffer_.append(chunk, received);
+    }
+    std::memcpy(out, readBuffer_.data(), size);
+    readBuffer_.erase(0, size);
+    return true;
+}
+
+/**
+ * Reader thread: decodes frames until the connection closes.
+ */
+void WebSocket::ReadLoop(){
+    std::string message;
+    std::vector<char> payload;
+
+    while(true){
+        unsigned char header[2];
+        if(!ReadExact((char*)header, 2)) break;
+        bool fin = header[0] & 0x80;
+        std::uint8_t opcode = header[0] & 0x0F;
+
+        std::uint64_t length = header[1] & 0x7F;
+        if(length == 126){
+            unsigned char extended[2];
+            if(!ReadExact((char*)extended, 2)) break;
+            length = (extended[0] << 8) | extended[1];
+        } else if(length == 127){
+            unsigned char extended[8];
+            if(!ReadExact((char*)extended, 8)) break;
+            length = 0;
+            for(unsigned char byte : extended) length = (length << 8) | byte;
+        }
+        if(length > MAX_MESSAGE) break;
+
+        payload.resize(length);
+        if(length > 0 && !ReadExact(payload.data(), length)) break;
+
+        if(opcode == OP_TEXT || opcode == OP_CONTINUATION){
+            message.append(payload.data(), payload.size());
+            if(fin){
+                if(onMessage_) onMessage_(std::move(message));
+                message.clear();
+            }
+        } else if(opcode == OP_PING){
+            SendFrame(OP_PONG, payload.data(), payload.size());
+        } else if(opcode == OP_CLOSE){
+            break;
+        }
+    }
+
+    open_ = false;
+    if(onClose_) onClose_();
+}
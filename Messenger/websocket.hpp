@@ -0,0 +1,59 @@
+//
+//  websocket.hpp
+//  Messenger
+//
+//  Created by АА on 17.10.26.
+//
+
+#ifndef websocket_hpp
+#define websocket_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+/**
+ * Minimal RFC 6455 WebSocket client over a plain TCP socket.
+ *
+ * Sends masked text frames and delivers every complete text message to a
+ * handler on a background reader thread. Pings are answered automatically.
+ */
+class WebSocket{
+public:
+    using MessageHandler = std::function<void(std::string&& message)>;
+    using CloseHandler = std::function<void()>;
+
+    WebSocket();
+    ~WebSocket();
+
+    WebSocket(const WebSocket&) = delete;
+    WebSocket& operator=(const WebSocket&) = delete;
+
+    bool Connect(const std::string& host, int port, const std::string& path, MessageHandler onMessage, CloseHandler onClose);
+    bool SendText(const std::string& text);
+    void Close();
+    bool IsOpen() const { return open_; }
+
+private:
+    bool Handshake(const std::string& host, int port, const std::string& path);
+    bool SendFrame(std::uint8_t opcode, const char* data, std::size_t size);
+    bool ReadExact(char* out, std::size_t size);
+    void ReadLoop();
+
+    int fd_;
+    std::atomic<bool> open_;
+    std::string readBuffer_;    // Bytes received but not consumed yet, reader thread only
+    std::mutex sendMutex_;      // Frames from different threads must not interleave
+    std::mt19937 random_;       // Mask keys, guarded by sendMutex_
+    MessageHandler onMessage_;
+    CloseHandler onClose_;
+    std::thread reader_;
+};
+
+#endif /* websocket_hpp */
@@ -0,0 +1,91 @@
+// MessagePack encoder for the response payloads the server sends
+// (objects, arrays, strings, integers, floats, booleans, null, Buffers).
+// Used when a client prefers application/msgpack over JSON.
+
+/**
+ * Encodes a value into a MessagePack Buffer.
+ */
+export function encode(value){
+	const parts = []
+	write(value, parts)
+	return Buffer.concat(parts)
+}
+
+function header(type, size, bytes){
+	const buffer = Buffer.alloc(1 + bytes)
+	buffer[0] = type
+	if (bytes === 1) buffer.writeUInt8(size, 1)
+	else if (bytes === 2) buffer.writeUInt16BE(size, 1)
+	else if (bytes === 4) buffer.writeUInt32BE(size, 1)
+	return buffer
+}
+
+function writeInteger(value, parts){
+	if (value >= 0) {
+		if (value < 0x80) parts.push(Buffer.from([value]))
+		else if (value < 0x100) parts.push(header(0xcc, value, 1))
+		else if (value < 0x10000) parts.push(header(0xcd, value, 2))
+		else if (value < 0x100000000) parts.push(header(0xce, value, 4))
+		else {
+			const buffer = Buffer.alloc(9)
+			buffer[0] = 0xcf
+			buffer.writeBigUInt64BE(BigInt(value), 1)
+			parts.push(buffer)
+		}
+	} else {
+		if (value >= -32) parts.push(Buffer.from([value & 0xff]))
+		else if (value >= -0x80) { const b = Buffer.alloc(2); b[0] = 0xd0; b.writeInt8(value, 1); parts.push(b) }
+		else if (value >= -0x8000) { const b = Buffer.alloc(3); b[0] = 0xd1; b.writeInt16BE(value, 1); parts.push(b) }
+		else if (value >= -0x80000000) { const b = Buffer.alloc(5); b[0] = 0xd2; b.writeInt32BE(value, 1); parts.push(b) }
+		else { const b = Buffer.alloc(9); b[0] = 0xd3; b.writeBigInt64BE(BigInt(value), 1); parts.push(b) }
+	}
+}
+
+function write(value, parts){
+	if (value === null || value === undefined) {
+		parts.push(Buffer.from([0xc0]))
+	} else if (value === false || value === true) {
+		parts.push(Buffer.from([value ? 0xc3 : 0xc2]))
+	} else if (typeof value === 'number') {
+		if (Number.isSafeInteger(value)) {
+			writeInteger(value, parts)
+		} else {
+			const buffer = Buffer.alloc(9)
+			buffer[0] = 0xcb
+			buffer.writeDoubleBE(value, 1)
+			parts.push(buffer)
+		}
+	} else if (typeof value === 'string') {
+		const bytes = Buffer.from(value, 'utf-8')
+		const length = bytes.length
+		if (length < 32) parts.push(Buffer.from([0xa0 | length]))
+		else if (length < 0x100) parts.push(header(0xd9, length, 1))
+		else if (length < 0x10000) parts.push(header(0xda, length, 2))
+		else parts.push(header(0xdb, length, 4))
+		parts.push(bytes)
+	} else if (Buffer.isBuffer(value)) {
+		const length = value.length
+		if (length < 0x100) parts.push(header(0xc4, length, 1))
+		else if (length < 0x10000) parts.push(header(0xc5, length, 2))
+		else parts.push(header(0xc6, length, 4))
+		parts.push(value)
+	} else if (Array.isArray(value)) {
+		const length = value.length
+		if (length < 16) parts.push(Buffer.from([0x90 | length]))
+		else if (length < 0x10000) parts.push(header(0xdc, length, 2))
+		else parts.push(header(0xdd, length, 4))
+		value.forEach(el => write(el, parts))
+	} else if (typeof value === 'object') {
+		const keys = Object.keys(value).filter(key => value[key] !== undefined)
+		const length = keys.length
+		if (length < 16) parts.push(Buffer.from([0x80 | length]))
+		else if (length < 0x10000) parts.push(header(0xde, length, 2))
+		else parts.push(header(0xdf, length, 4))
+		keys.forEach(key => {
+			write(key, parts)
+			write(value[key], parts)
+		})
+	} else {
+		throw new TypeError(`Cannot encode ${typeof value} as MessagePack`)
+	}
+}
@@ -3,6 +3,10 @@ import express from 'express'          // For creating HTTP server
 import crypto  from 'crypto'           // For encryption and decryption
 import dotenv from 'dotenv'            // For loading environment variables from .env file
 import { MongoClient } from 'mongodb'  // For MongoDB database interaction
+import { attachWebSocket } from './websocket.js' // Persistent client channel
+import * as msgpack from './msgpack.js'           // Compact binary responses
+import zlib from 'zlib'                            // Response compression
+import { promisify } from 'util'
 
 const app = express()
 
@@ -53,12 +57,342 @@ function decrypt(encrypted){
 
 let db;
 
+// Bodies smaller than this are sent uncompressed
+const COMPRESS_THRESHOLD = 1024
+
+// Supported Content-Encodings in order of preference; compression runs on
+// the libuv thread pool so large histories don't block the event loop.
+// zstd is only offered by Node versions whose zlib has it.
+const compressors = {}
+if (typeof zlib.zstdCompress === 'function') {
+	compressors.zstd = promisify(zlib.zstdCompress)
+}
+compressors.br = (body) => promisify(zlib.brotliCompress)(body, {
+	params: { [zlib.constants.BROTLI_PARAM_QUALITY]: 4, [zlib.constants.BROTLI_PARAM_SIZE_HINT]: body.length }
+})
+compressors.gzip = promisify(zlib.gzip)
+compressors.deflate = promisify(zlib.deflate)
+
+/**
+ * Sends a response payload as MessagePack if the client prefers it
+ * (Accept: application/msgpack), as JSON otherwise. Bodies of at least
+ * COMPRESS_THRESHOLD bytes are compressed with the best encoding the
+ * client accepts.
+ */
+async function sendPayload(req, res, value){
+	let body
+	if (req.accepts(['application/json', 'application/msgpack']) === 'application/msgpack') {
+		res.type('application/msgpack')
+		body = msgpack.encode(value)
+	} else {
+		res.type('application/json')
+		body = Buffer.from(JSON.stringify(value), 'utf-8')
+	}
+	res.vary('Accept')
+	res.vary('Accept-Encoding')
+
+	// Small bodies cost more to compress than they save on the wire
+	if (body.length >= COMPRESS_THRESHOLD) {
+		const encoding = req.acceptsEncodings(Object.keys(compressors))
+		if (encoding && encoding !== 'identity') {
+			body = await compressors[encoding](body)
+			res.set('Content-Encoding', encoding)
+		}
+	}
+	res.send(body)
+}
+
+// Longest time a /wait-chat request is held open before returning empty; clients
+// start well below it and only ask for this much once their chat went idle
+const MAX_WAIT_MS = 120000
+
+// Pending /wait-chat requests, keyed by conversation (see chatKey)
+const chatWaiters = new Map()
+
+// WebSocket chat subscriptions, keyed by conversation; unlike waiters they stay registered
+const chatSubscribers = new Map()
+
+// Open WebSocket connections, for pushing user list changes
+const sockets = new Set()
+
+/**
+ * Builds a key identifying the conversation between two users,
+ * independent of who is sender and who is recipient.
+ */
+function chatKey(a, b){
+	return a < b ? `${a}\u0000${b}` : `${b}\u0000${a}`
+}
+
+/**
+ * Wakes every /wait-chat request parked on the conversation between a and b
+ * and tells its WebSocket subscribers to push the new messages.
+ */
+function notifyChatWaiters(a, b){
+	const key = chatKey(a, b)
+	chatSubscribers.get(key)?.forEach(push => push())
+
+	const waiters = chatWaiters.get(key)
+	if (!waiters) return
+	chatWaiters.delete(key)
+	waiters.forEach(wake => wake())
+}
+
+/**
+ * Registers push to be called whenever a message is stored between a and b.
+ * Returns a function that removes the subscription.
+ */
+function subscribeChat(a, b, push){
+	const key = chatKey(a, b)
+	if (!chatSubscribers.has(key)) chatSubscribers.set(key, new Set())
+	chatSubscribers.get(key).add(push)
+	return () => {
+		const subscribers = chatSubscribers.get(key)
+		if (!subscribers) return
+		subscribers.delete(push)
+		if (subscribers.size === 0) chatSubscribers.delete(key)
+	}
+}
+
+/**
+ * Converts a stored chat document into the message object clients receive.
+ */
+function toWire(el){
+	const wire = {
+		// Messages stored before sequence numbers existed get one from backfillSequences
+		seq: el.seq,
+		sendername: el.sendername,
+		gettername: el.gettername,
+		// Messages stored before sentAt existed fall back to the ObjectId creation time
+		timestamp: el.sentAt ?? el._id?.getTimestamp?.().getTime() ?? 0,
+		message: decrypt({
+			content: el.message.encryptedData,
+			iv: el.message.iv
+		})
+	}
+	// Lets the sender match a delta to a message still pending on its screen
+	if (el.clientId) wire.clientId = el.clientId
+	return wire
+}
+
+/**
+ * Encrypts and stores a message from username to friendname, then wakes
+ * everyone waiting on that conversation. Returns the stored message as
+ * clients receive it, or null on failure, so the sender can show it without
+ * fetching it back.
+ * clientId, if given, identifies the message across client retries: a
+ * message whose clientId is already stored is acknowledged with the stored
+ * copy but not stored again.
+ */
+async function storeMessage(username, friendname, message, clientId){
+	const findRetry = () => db.collection("chats").findOne({ sendername: username, clientId: String(clientId) })
+	if (clientId) {
+		const stored = await findRetry()
+		if (stored) return toWire(stored)
+	}
+
+	// Encrypt the message content before saving
+	const hashMessage = encrypt(message)
+
+	// Save the message to the chats collection with its sequence number
+	const seq = await allocateSequence()
+	const entry = {
+		seq: seq,
+		sentAt: Date.now(),
+		sendername: username,
+		gettername: friendname,
+		message: {
+			encryptedData: hashMessage.content,
+			iv: hashMessage.iv
+		}
+	}
+	// Only set when present: the unique index covers documents that have the field
+	if (clientId) entry.clientId = String(clientId)
+
+	let result
+	try {
+		result = await db.collection("chats").insertOne(entry)
+	} catch (error) {
+		// The number is never used; readers may move past it
+		settleSequence(seq)
+		// A retry raced the original request, which already stored the message
+		if (error.code === 11000 && clientId) {
+			const stored = await findRetry()
+			return stored ? toWire(stored) : null
+		}
+		throw error
+	}
+
+	if (!result) {
+		settleSequence(seq)
+		return null
+	}
+	// Waiters are woken once the message is visible, see settleSequence
+	settleSequence(seq, username, friendname)
+	const stored = { seq: entry.seq, sendername: username, gettername: friendname, timestamp: entry.sentAt, message }
+	if (entry.clientId) stored.clientId = entry.clientId
+	return stored
+}
+
+/**
+ * Lists every user except username as { id, username } objects.
+ */
+async function loadUsers(username){
+	// Retrieve all users from DB
+	const result = await db.collection("users").find().toArray()
+
+	let array = []
+
+	// Filter out the requesting user and format response
+	result.forEach(el => {
+		if (username !== el.username) {
+			array.push({ id: parseInt(el.id), username: el.username })
+		}
+	})
+	return array
+}
+
+/**
+ * Loads and decrypts the messages between two users with a sequence number above since.
+ * since = 0 returns the whole conversation.
+ *
+ * With page.limit only the newest limit messages are loaded, and page.before
+ * (a sequence number) excludes that message and everything newer. page.more
+ * is set to whether older messages remain.
+ */
+async function loadChat(username, friendname, since, page = {}){
+	const query = {
+		$or: [
+			{ sendername: username, gettername: friendname },
+			{ sendername: friendname, gettername: username }
+		]
+	}
+	// Messages above the watermark may have lower-numbered ones still being stored
+	query.seq = { $lte: visibleSequence() }
+	if (since > 0) query.seq.$gt = since
+	if (page.before > 0) query.seq.$lt = page.before
+
+	// Query chats collection for messages between the two users (both directions)
+	let result
+	if (page.limit > 0) {
+		// Newest first so only one page is read and decrypted; one extra tells if more remain
+		result = await db.collection("chats").find(query).sort({ seq: -1 }).limit(page.limit + 1).toArray()
+		page.more = result.length > page.limit
+		result = result.slice(0, page.limit).reverse()
+	} else {
+		result = await db.collection("chats").find(query).sort({ seq: 1 }).toArray()
+	}
+
+	let array = []
+
+	// Decrypt each message before sending to client
+	result.forEach(el => {
+		array.push(toWire(el))
+	})
+	return array
+}
+
+/**
+ * Returns the next value of a named monotonic counter.
+ * Used to give every chat message a server-assigned sequence number
+ * that clients can sync from.
+ */
+async function nextSequence(name, count = 1){
+	const counter = await db.collection("counters").findOneAndUpdate(
+		{ _id: name },
+		{ $inc: { seq: count } },
+		{ upsert: true, returnDocument: 'after' }
+	)
+	return counter.seq
+}
+
+// Inserts can commit out of sequence order, so readers only see messages up
+// to a watermark below which every number handed out has been stored or
+// given up. Otherwise a reader could see seq 11, move its cursor there and
+// never get seq 10 committing just after.
+let highestSequence = 0             // Highest number handed out so far
+const uncommitted = new Set()       // Numbers handed out whose insert has not finished
+let heldBack = []                   // Stored above the watermark, as { seq, a, b }, waiting to be announced
+let allocating = Promise.resolve()
+
+/**
+ * Highest sequence number readers may see.
+ */
+function visibleSequence(){
+	if (uncommitted.size === 0) return highestSequence
+	let lowest = Infinity
+	uncommitted.forEach(seq => { lowest = Math.min(lowest, seq) })
+	return lowest - 1
+}
+
+/**
+ * Hands out the next chat sequence number and marks it uncommitted until
+ * settleSequence. Allocations run one at a time so a number is known here
+ * before any higher one is.
+ */
+function allocateSequence(){
+	const seq = allocating.then(() => nextSequence("chats")).then(seq => {
+		uncommitted.add(seq)
+		highestSequence = Math.max(highestSequence, seq)
+		return seq
+	})
+	allocating = seq.catch(() => {})
+	return seq
+}
+
+/**
+ * Finishes the insert that took seq: stored in the conversation between a
+ * and b, or abandoned when a is not given. Wakes the conversations whose
+ * messages became visible as a result.
+ */
+function settleSequence(seq, a, b){
+	uncommitted.delete(seq)
+	if (a !== undefined) heldBack.push({ seq, a, b })
+
+	const visible = visibleSequence()
+	const ready = heldBack.filter(held => held.seq <= visible)
+	if (ready.length === 0) return
+	heldBack = heldBack.filter(held => held.seq > visible)
+	ready.forEach(held => notifyChatWaiters(held.a, held.b))
+}
+
+/**
+ * One-off migration for messages stored before sequence numbers existed:
+ * numbers them in insertion (_id) order after the current counter. Run at
+ * startup before requests are served, so on an upgrade from a server
+ * without sequence numbers they come out as 1..n and sort before every new
+ * message. Does nothing once every message has a number.
+ */
+async function backfillSequences(){
+	const legacy = await db.collection("chats").find({ seq: { $exists: false } }).sort({ _id: 1 }).toArray()
+	if (legacy.length > 0) {
+		// Reserve the whole block at once, then number it from its start
+		const first = await nextSequence("chats", legacy.length) - legacy.length + 1
+		await db.collection("chats").bulkWrite(legacy.map((el, i) => ({
+			updateOne: { filter: { _id: el._id }, update: { $set: { seq: first + i } } }
+		})))
+		console.log(`Numbered ${legacy.length} messages stored before sequence sync`)
+	}
+	// Paging and delta sync both go by seq; a message without a positive one
+	// (written meanwhile by an older server) would never be returned
+	const unnumbered = await db.collection("chats").countDocuments({ $or: [{ seq: { $exists: false } }, { seq: { $lte: 0 } }] })
+	if (unnumbered > 0) {
+		console.error(`${unnumbered} messages still have no sequence number, restart to number them`)
+	}
+	highestSequence = (await db.collection("counters").findOne({ _id: "chats" }))?.seq ?? 0
+}
+
 // Connect to MongoDB database
 const client = new MongoClient(uri);
 try {
     await client.connect();
     db = client.db(dbName); 
     console.log("Database connected successfully");
+
+    // Delta chat sync queries messages of one conversation by sequence number
+    await db.collection("chats").createIndex({ sendername: 1, gettername: 1, seq: 1 })
+    // Outbox retries are deduplicated by the sender's clientId
+    await db.collection("chats").createIndex({ sendername: 1, clientId: 1 }, { unique: true, partialFilterExpression: { clientId: { $exists: true } } })
+    await backfillSequences()
 } catch (error) {
     console.error("Client connection error:", error);
 }
@@ -87,6 +421,7 @@ app.post('/register', async (req, res) => {
 		})
 
 		if (result) {
+			broadcastUsers()
 			res.json({ success: true })
 		} else {
 			res.json({ success: false })
@@ -126,91 +461,200 @@ app.post('/send-message', async (req, res) => {
 		const username = req.body.username
 		const friendname = req.body.friendname
 		const message = req.body.message
+		const clientId = req.body.clientId
 
-		// Encrypt the message content before saving
-		const hashMessage = encrypt(message)
-
-		// Save the message to the chats collection
-		const result = await db.collection("chats").insertOne({
-			sendername: username,
-			gettername: friendname,
-			message: {
-				encryptedData: hashMessage.content,
-				iv: hashMessage.iv
-			}
-		})
-
-		if (result) {
-			res.json({ success: true })
-		} else {
-			res.json({ success: false })
-		}
+		// The stored message lets the sender show it without fetching the chat
+		const stored = await storeMessage(username, friendname, message, clientId)
+		res.json(stored ? { success: true, message: stored } : { success: false })
 	} catch (error) {
 		console.log(error)
 	}
 })
 
+// Largest page a /get-chat request may ask for
+const MAX_PAGE = 1000
+
 // Get chat messages between two users endpoint
 app.post('/get-chat', async (req, res) => {
 	try {
 		const username = req.body.username
 		const friendname = req.body.friendname
+		// Only messages with a sequence number above this are returned (0 = whole chat)
+		const since = Number(req.body.since) || 0
+		// Paging: the newest limit messages older than before; without limit, everything
+		const page = {
+			limit: Math.min(Number(req.body.limit) || 0, MAX_PAGE),
+			before: Number(req.body.before) || 0
+		}
 
-		// Query chats collection for messages between the two users (both directions)
-		const result = await db.collection("chats").find({
-			$or: [
-				{ sendername: username, gettername: friendname },
-				{ sendername: friendname, gettername: username }
-			]
-		}).toArray()
-
-		let array = []
-
-		// Decrypt each message before sending to client
-		result.forEach(el => {
-			array.push({
-				sendername: el.sendername,
-				gettername: el.gettername,
-				message: decrypt({
-					content: el.message.encryptedData,
-					iv: el.message.iv
-				})
-			})
-		})
+		const array = await loadChat(username, friendname, since, page)
+		// Continuation for the next older page: pass it back as before
+		if (page.more && array.length > 0) {
+			res.set('X-Chat-Before', String(array[0].seq))
+		}
 
 		// Respond with the decrypted chat messages array
-		res.json(array)
+		await sendPayload(req, res, array)
 
 	} catch (error) {
 		console.log(error)
 	}
 })
 
-// Get list of users except the requesting user
-app.post('/get-users', async (req, res) => {
+// Long-poll variant of /get-chat: if nothing newer than since exists yet,
+// holds the request until a message is sent in the conversation or the timeout passes
+app.post('/wait-chat', async (req, res) => {
 	try {
 		const username = req.body.username
+		const friendname = req.body.friendname
+		const since = Number(req.body.since) || 0
+		const timeout = Math.min(Number(req.body.timeout) || MAX_WAIT_MS, MAX_WAIT_MS)
+
+		// The waiter is registered before the first load, so a message stored
+		// while that load runs still wakes it
+		const key = chatKey(username, friendname)
+		let timer
+		let answered = false
+		const respond = async (array) => {
+			if (answered) return
+			answered = true
+			drop()
+			await sendPayload(req, res, array)
+		}
+		const wake = async () => {
+			try {
+				await respond(await loadChat(username, friendname, since))
+			} catch (error) {
+				console.log(error)
+			}
+		}
+		// Forget the waiter once the response is done or the client gives up first
+		const drop = () => {
+			clearTimeout(timer)
+			const waiters = chatWaiters.get(key)
+			if (!waiters) return
+			waiters.delete(wake)
+			if (waiters.size === 0) chatWaiters.delete(key)
+		}
+		timer = setTimeout(() => {
+			respond([]).catch(error => console.log(error))
+		}, timeout)
 
-		// Retrieve all users from DB
-		const result = await db.collection("users").find().toArray()
+		if (!chatWaiters.has(key)) chatWaiters.set(key, new Set())
+		chatWaiters.get(key).add(wake)
+		res.on('close', drop)
 
-		let array = []
+		const array = await loadChat(username, friendname, since)
+		if (array.length > 0) {
+			await respond(array)
+		}
+	} catch (error) {
+		console.log(error)
+	}
+})
 
-		// Filter out the requesting user and format response
-		result.forEach(el => {
-			if (username !== el.username) {
-				array.push({ id: parseInt(el.id), username: el.username })
-			}
-		})
+// Get list of users except the requesting user
+app.post('/get-users', async (req, res) => {
+	try {
+		const username = req.body.username
 
 		// Send back the list of other users
-		res.json(array)
+		await sendPayload(req, res, await loadUsers(username))
 	} catch (error) {
 		console.log(error)
 	}
 })
 
 // Start the server
-app.listen(PORT, () => {
+const server = app.listen(PORT, () => {
 	console.log(`Server running at http://127.0.0.1:${PORT}`)
 })
+
+// Clients reuse pooled keep-alive connections between polls, so keep idle
+// sockets open well past the polling interval instead of Node's 5s default
+server.keepAliveTimeout = 65000
+server.headersTimeout = 66000
+
+/**
+ * Pushes the current user list to every WebSocket client that said hello.
+ */
+function broadcastUsers(){
+	sockets.forEach(async connection => {
+		if (!connection.username) return
+		try {
+			connection.send(JSON.stringify({ type: 'users', users: await loadUsers(connection.username) }))
+		} catch (error) {
+			console.log(error)
+		}
+	})
+}
+
+// WebSocket channel at /ws: one long-lived connection per client carrying
+// sends, chat updates and user list changes as small JSON frames.
+//   -> { type: 'hello', username }
+//   -> { type: 'subscribe', friendname, since, limit } <- { type: 'chat', messages }
+//   -> { type: 'send', ref, friendname, message, clientId } <- { type: 'ack', ref, success, message }
+//   -> { type: 'users' }                          <- { type: 'users', users }
+// Any other frame sent before hello closes the connection.
+attachWebSocket(server, '/ws', connection => {
+	let unsubscribe = null
+	sockets.add(connection)
+
+	connection.on('message', async text => {
+		try {
+			const msg = JSON.parse(text)
+			// Every other frame acts on behalf of the user named in hello
+			if (msg.type !== 'hello' && !connection.username) {
+				connection.close()
+				return
+			}
+			switch (msg.type) {
+			case 'hello':
+				if (typeof msg.username !== 'string' || msg.username === '') {
+					connection.close()
+					return
+				}
+				connection.username = msg.username
+				break
+			case 'subscribe': {
+				unsubscribe?.()
+				const username = connection.username
+				const friendname = msg.friendname
+				let since = Number(msg.since) || 0
+				// Like /get-chat paging: a client with no history first gets only the newest page
+				let page = since === 0 && Number(msg.limit) > 0 ? { limit: Math.min(Number(msg.limit), MAX_PAGE) } : {}
+
+				// Pushes are chained so each one continues from the previous cursor
+				let pushing = Promise.resolve()
+				const push = () => {
+					pushing = pushing.then(async () => {
+						const messages = await loadChat(username, friendname, since, page)
+						page = {}
+						if (messages.length === 0) return
+						since = messages.reduce((max, el) => Math.max(max, el.seq), since)
+						connection.send(JSON.stringify({ type: 'chat', messages: messages }))
+					}).catch(error => console.log(error))
+				}
+				unsubscribe = subscribeChat(username, friendname, push)
+				push()
+				break
+			}
+			case 'send': {
+				const stored = await storeMessage(connection.username, msg.friendname, msg.message, msg.clientId)
+				connection.send(JSON.stringify(stored ? { type: 'ack', ref: msg.ref, success: true, message: stored } : { type: 'ack', ref: msg.ref, success: false }))
+				break
+			}
+			case 'users':
+				connection.send(JSON.stringify({ type: 'users', users: await loadUsers(connection.username) }))
+				break
+			}
+		} catch (error) {
+			console.log(error)
+		}
+	})
+
+	connection.on('close', () => {
+		unsubscribe?.()
+		sockets.delete(connection)
+	})
+})
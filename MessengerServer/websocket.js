@@ -0,0 +1,181 @@
+// Minimal RFC 6455 WebSocket server on top of Node's http 'upgrade' event.
+// Supports text frames, fragmentation, ping/pong and close; enough for the
+// messenger's JSON message channel without pulling in another dependency.
+import crypto from 'crypto'
+import { EventEmitter } from 'events'
+
+// Magic value from RFC 6455 used to compute Sec-WebSocket-Accept
+const WS_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+
+// Largest message accepted from a client
+const MAX_MESSAGE = 1 << 20
+
+const OP_CONTINUATION = 0x0
+const OP_TEXT = 0x1
+const OP_BINARY = 0x2
+const OP_CLOSE = 0x8
+const OP_PING = 0x9
+const OP_PONG = 0xA
+
+/**
+ * Encodes one unmasked frame (server to client frames are never masked).
+ */
+function encodeFrame(opcode, payload){
+	const length = payload.length
+	let header
+	if (length < 126) {
+		header = Buffer.alloc(2)
+		header[1] = length
+	} else if (length < 65536) {
+		header = Buffer.alloc(4)
+		header[1] = 126
+		header.writeUInt16BE(length, 2)
+	} else {
+		header = Buffer.alloc(10)
+		header[1] = 127
+		header.writeBigUInt64BE(BigInt(length), 2)
+	}
+	header[0] = 0x80 | opcode // FIN + opcode
+	return Buffer.concat([header, payload])
+}
+
+/**
+ * One accepted WebSocket connection.
+ * Emits 'message' with each complete text message and 'close' once.
+ */
+export class WebSocketConnection extends EventEmitter {
+	constructor(socket){
+		super()
+		this.socket = socket
+		this.buffer = Buffer.alloc(0)
+		this.fragments = []
+		this.closed = false
+
+		socket.setNoDelay(true)
+		socket.on('data', chunk => this.onData(chunk))
+		socket.on('close', () => this.finish())
+		socket.on('error', () => this.finish())
+	}
+
+	/**
+	 * Sends a text message as a single frame.
+	 */
+	send(text){
+		if (this.closed) return
+		this.socket.write(encodeFrame(OP_TEXT, Buffer.from(text, 'utf-8')))
+	}
+
+	/**
+	 * Starts the closing handshake and drops the connection.
+	 */
+	close(){
+		if (this.closed) return
+		this.socket.end(encodeFrame(OP_CLOSE, Buffer.alloc(0)))
+		this.finish()
+	}
+
+	finish(){
+		if (this.closed) return
+		this.closed = true
+		this.emit('close')
+	}
+
+	/**
+	 * Accumulates socket data and handles every complete frame in it.
+	 */
+	onData(chunk){
+		this.buffer = this.buffer.length ? Buffer.concat([this.buffer, chunk]) : chunk
+
+		while (this.buffer.length >= 2) {
+			const first = this.buffer[0]
+			const second = this.buffer[1]
+			const fin = (first & 0x80) !== 0
+			const opcode = first & 0x0F
+			const masked = (second & 0x80) !== 0
+
+			let length = second & 0x7F
+			let offset = 2
+			if (length === 126) {
+				if (this.buffer.length < 4) return
+				length = this.buffer.readUInt16BE(2)
+				offset = 4
+			} else if (length === 127) {
+				if (this.buffer.length < 10) return
+				length = Number(this.buffer.readBigUInt64BE(2))
+				offset = 10
+			}
+
+			// Clients must mask their frames, and oversized messages are refused
+			if (!masked || length > MAX_MESSAGE) {
+				this.close()
+				return
+			}
+			if (this.buffer.length < offset + 4 + length) return
+
+			const mask = this.buffer.subarray(offset, offset + 4)
+			const payload = Buffer.from(this.buffer.subarray(offset + 4, offset + 4 + length))
+			for (let i = 0; i < payload.length; i++) {
+				payload[i] ^= mask[i & 3]
+			}
+			this.buffer = this.buffer.subarray(offset + 4 + length)
+
+			this.onFrame(fin, opcode, payload)
+			if (this.closed) return
+		}
+	}
+
+	onFrame(fin, opcode, payload){
+		switch (opcode) {
+		case OP_TEXT:
+		case OP_BINARY:
+		case OP_CONTINUATION:
+			this.fragments.push(payload)
+			if (this.fragments.reduce((sum, part) => sum + part.length, 0) > MAX_MESSAGE) {
+				this.close()
+				return
+			}
+			if (fin) {
+				const message = Buffer.concat(this.fragments).toString('utf-8')
+				this.fragments = []
+				this.emit('message', message)
+			}
+			break
+		case OP_PING:
+			this.socket.write(encodeFrame(OP_PONG, payload))
+			break
+		case OP_PONG:
+			break
+		case OP_CLOSE:
+			this.close()
+			break
+		default:
+			this.close()
+		}
+	}
+}
+
+/**
+ * Accepts WebSocket upgrades for path on an http.Server and calls
+ * onConnection with a WebSocketConnection for each of them.
+ */
+export function attachWebSocket(server, path, onConnection){
+	server.on('upgrade', (req, socket, head) => {
+		const key = req.headers['sec-websocket-key']
+		if (req.url !== path || !key || (req.headers.upgrade || '').toLowerCase() !== 'websocket') {
+			socket.end('HTTP/1.1 400 Bad Request\r\n\r\n')
+			return
+		}
+
+		const accept = crypto.createHash('sha1').update(key + WS_GUID).digest('base64')
+		socket.write(
+			'HTTP/1.1 101 Switching Protocols\r\n' +
+			'Upgrade: websocket\r\n' +
+			'Connection: Upgrade\r\n' +
+			`Sec-WebSocket-Accept: ${accept}\r\n\r\n`
+		)
+
+		const connection = new WebSocketConnection(socket)
+		onConnection(connection)
+		if (head && head.length) connection.onData(head)
+	})
+}